@@ -0,0 +1,79 @@
+/*
+ * Copyright 2014 Oliver Giles
+ *
+ * This file is part of SequelJoe. SequelJoe is licensed under the
+ * GNU GPL version 3. See LICENSE or <http://www.gnu.org/licenses/>
+ * for more information
+ */
+#include "benchmark.h"
+#include "fixture.h"
+
+#include <QElapsedTimer>
+#include <QJsonDocument>
+#include <QVector>
+#include <QTextStream>
+#include <algorithm>
+
+bool Benchmark::enabled(QString name) const {
+    if(filter.isEmpty())
+        return true;
+    for(const QString& prefix : filter)
+        if(name.startsWith(prefix) || prefix.startsWith(name))
+            return true;
+    return false;
+}
+
+void Benchmark::measure(QString name, QJsonObject params, qint64 ops, std::function<void()> op, std::function<void()> setup) {
+    if(!enabled(name))
+        return;
+
+    if(setup)
+        setup();
+    op();
+
+    QVector<qint64> times;
+    QElapsedTimer budget;
+    QElapsedTimer timer;
+    budget.start();
+    while(times.count() < MAX_ITERATIONS && (times.count() < MIN_ITERATIONS || budget.elapsed() < budgetMs)) {
+        if(setup)
+            setup();
+        timer.start();
+        op();
+        times.append(timer.nsecsElapsed());
+    }
+
+    qint64 total = 0;
+    for(qint64 t : times)
+        total += t;
+    std::sort(times.begin(), times.end());
+    QJsonObject extra;
+    extra["minNsPerOp"] = double(times.first()) / ops;
+    extra["medianNsPerOp"] = double(times.at(times.count() / 2)) / ops;
+    record(name, params, times.count(), ops, total, extra);
+}
+
+void Benchmark::record(QString name, QJsonObject params, qint64 iterations, qint64 ops, qint64 nsecs, QJsonObject extra) {
+    QJsonObject r = extra;
+    r["name"] = name;
+    for(auto it = params.constBegin(); it != params.constEnd(); ++it)
+        r[it.key()] = it.value();
+    r["iterations"] = double(iterations);
+    r["opsPerIteration"] = double(ops);
+    r["totalMs"] = nsecs / 1e6;
+    double nsPerOp = double(nsecs) / iterations / ops;
+    r["nsPerOp"] = nsPerOp;
+    r["opsPerSec"] = nsPerOp > 0 ? 1e9 / nsPerOp : 0.0;
+    all.append(r);
+
+    // progress on stderr, the JSON document goes to stdout or a file
+    QTextStream(stderr) << name << " " << QJsonDocument(QJsonObject(params)).toJson(QJsonDocument::Compact)
+                        << ": " << nsPerOp << " ns/op (" << iterations << " iterations)\n";
+}
+
+QJsonObject fixtureParams(const Fixture& f) {
+    QJsonObject p;
+    p["schema"] = f.schemaName();
+    p["rows"] = double(f.rows());
+    return p;
+}
@@ -0,0 +1,79 @@
+/*
+ * Copyright 2014 Oliver Giles
+ *
+ * This file is part of SequelJoe. SequelJoe is licensed under the
+ * GNU GPL version 3. See LICENSE or <http://www.gnu.org/licenses/>
+ * for more information
+ */
+#ifndef _SEQUELJOE_BENCHMARK_H_
+#define _SEQUELJOE_BENCHMARK_H_
+
+#include <QJsonArray>
+#include <QJsonObject>
+#include <QString>
+#include <QStringList>
+#include <functional>
+
+#include "latencyproxy.h"
+
+class Fixture;
+
+// Times operations and collects the results as JSON. Each measurement is
+// one warm-up call followed by as many timed calls as fit in the time
+// budget, with at least MIN_ITERATIONS and at most MAX_ITERATIONS
+class Benchmark {
+public:
+    explicit Benchmark(int budgetMs) : budgetMs(budgetMs) {}
+
+    // only measurements whose name starts with one of these are run; all
+    // of them if empty
+    void setFilter(QStringList prefixes) { filter = prefixes; }
+    // whether the named measurement, or any in the group of that name, is run
+    bool enabled(QString name) const;
+
+    // ops is the number of operations one call of op performs, so that
+    // batched operations are reported per operation. setup, if given, runs
+    // before each call of op and isn't timed
+    void measure(QString name, QJsonObject params, qint64 ops, std::function<void()> op,
+            std::function<void()> setup = std::function<void()>());
+    // a measurement taken elsewhere, e.g. a throughput over a socket
+    void record(QString name, QJsonObject params, qint64 iterations, qint64 ops, qint64 nsecs, QJsonObject extra = QJsonObject());
+
+    QJsonArray results() const { return all; }
+
+private:
+    enum { MIN_ITERATIONS = 3, MAX_ITERATIONS = 100000 };
+
+    int budgetMs;
+    QStringList filter;
+    QJsonArray all;
+};
+
+// parameters of a measurement against a fixture
+QJsonObject fixtureParams(const Fixture& f);
+
+void benchDriver(Benchmark& b, Fixture& f);
+// independent of the data, so run against one fixture only
+void benchQuote(Benchmark& b, Fixture& f);
+void benchModel(Benchmark& b, Fixture& f);
+void benchView(Benchmark& b, Fixture& f);
+void benchHighlighter(Benchmark& b, QList<int> scriptSizes);
+
+struct TunnelTarget {
+    QByteArray sshHost;
+    QByteArray sshPort;
+    QByteArray sshUser;
+    QByteArray sshKeyPath;
+    QByteArray sshPass;
+    // an echo service, as reached from the SSH server
+    QByteArray echoHost;
+    int echoPort;
+    bool acceptUnknownHost;
+    qint64 payloadBytes;
+    // emulated link to the SSH server, if not null
+    LinkShape shape;
+};
+// returns false with the reason in error if the tunnel couldn't be opened
+bool benchTunnel(Benchmark& b, const TunnelTarget& t, QString* error);
+
+#endif // _SEQUELJOE_BENCHMARK_H_
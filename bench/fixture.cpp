@@ -0,0 +1,123 @@
+/*
+ * Copyright 2014 Oliver Giles
+ *
+ * This file is part of SequelJoe. SequelJoe is licensed under the
+ * GNU GPL version 3. See LICENSE or <http://www.gnu.org/licenses/>
+ * for more information
+ */
+#include "fixture.h"
+#include "savedconfig.h"
+
+#include <QDir>
+#include <QFile>
+#include <QSettings>
+#include <QSqlDatabase>
+#include <QSqlError>
+#include <QSqlQuery>
+#include <QTextStream>
+
+UpdateResult BenchConnection::queryTableUpdate(QString query) {
+    if(!captureUpdates)
+        return DbConnection::queryTableUpdate(query);
+    lastUpdate = query;
+    return UpdateResult{0, 0};
+}
+
+Fixture::Fixture(Layout layout, int rows, QString dir) :
+    lay(layout),
+    nRows(rows),
+    dir(dir),
+    db(nullptr)
+{
+}
+
+Fixture::~Fixture() {
+    if(db) {
+        db->cleanup();
+        delete db;
+    }
+}
+
+QString Fixture::path() const {
+    return QDir(dir).filePath(schemaName() + "-" + QString::number(nRows) + ".sqlite");
+}
+
+bool Fixture::open(QString* error) {
+    if(!QFile::exists(path()) && !generate(path(), error))
+        return false;
+
+    QSettings settings(QDir(dir).filePath(schemaName() + "-" + QString::number(nRows) + ".ini"), QSettings::IniFormat);
+    settings.setValue(SavedConfig::KEY_TYPE, "QSQLITE");
+    settings.setValue(SavedConfig::KEY_DBNM, path());
+    db = new BenchConnection(settings);
+
+    // without a worker thread the connection is made before start returns
+    QString failure;
+    QObject::connect(db, &DbConnection::connectionFailed, [&](QString reason){ failure = reason; });
+    db->start();
+    if(!failure.isEmpty()) {
+        *error = failure;
+        return false;
+    }
+    return true;
+}
+
+bool Fixture::generate(QString file, QString* error) {
+    QTextStream(stderr) << "generating " << file << "\n";
+    QString partial = file + ".partial";
+    QFile::remove(partial);
+
+    bool ok;
+    {
+        QSqlDatabase gen = QSqlDatabase::addDatabase("QSQLITE", "fixture");
+        gen.setDatabaseName(partial);
+        ok = gen.open();
+        QSqlQuery q(gen);
+        // rows are derived from their id so that every run sees the same data
+        QString rows = "WITH RECURSIVE seq(n) AS (SELECT 1 UNION ALL SELECT n + 1 FROM seq WHERE n < " + QString::number(nRows) + ") ";
+        QStringList statements {"PRAGMA journal_mode = OFF", "PRAGMA synchronous = OFF"};
+        if(lay == NARROW) {
+            statements << "CREATE TABLE narrow (id INTEGER PRIMARY KEY, name VARCHAR(64), value INTEGER, created DATETIME)"
+                       << rows + "INSERT INTO narrow SELECT n, printf('name %d', n), (n * 7919) % 100003, "
+                                 "datetime(1400000000 + n * 37, 'unixepoch') FROM seq";
+        } else {
+            QStringList columns {"id INTEGER PRIMARY KEY", "active BOOLEAN"};
+            QStringList values {"n", "n % 3 = 0"};
+            for(int i = 1; i <= 8; ++i) {
+                columns << "i" + QString::number(i) + " INTEGER";
+                values << "(n * " + QString::number(i * 7919) + ") % 1000003";
+            }
+            for(int i = 1; i <= 6; ++i) {
+                columns << "r" + QString::number(i) + " REAL";
+                values << "n / " + QString::number(i + 1) + ".0";
+            }
+            for(int i = 1; i <= 8; ++i) {
+                columns << "s" + QString::number(i) + " VARCHAR(64)";
+                values << "printf('value %d of column " + QString::number(i) + "', n)";
+            }
+            // longer than TableModel's preview, so that it is fetched as a prefix
+            columns << "note TEXT" << "data BLOB" << "created DATETIME" << "updated DATETIME";
+            values << "printf('note %d ', n) || hex(zeroblob(150))"
+                   << "CAST(printf('%08x', n) AS BLOB) || zeroblob(56)"
+                   << "datetime(1400000000 + n * 37, 'unixepoch')"
+                   << "CASE WHEN n % 5 = 0 THEN NULL ELSE datetime(1400000000 + n * 41, 'unixepoch') END";
+            statements << "CREATE TABLE wide (" + columns.join(", ") + ")"
+                       << rows + "INSERT INTO wide SELECT " + values.join(", ") + " FROM seq";
+        }
+        for(int i = 0; ok && i < statements.count(); ++i) {
+            ok = q.exec(statements.at(i));
+            if(!ok)
+                *error = q.lastError().text();
+        }
+        if(!gen.isOpen())
+            *error = gen.lastError().text();
+        gen.close();
+    }
+    QSqlDatabase::removeDatabase("fixture");
+
+    if(ok)
+        ok = QFile::rename(partial, file);
+    else
+        QFile::remove(partial);
+    return ok;
+}
@@ -0,0 +1,60 @@
+/*
+ * Copyright 2014 Oliver Giles
+ *
+ * This file is part of SequelJoe. SequelJoe is licensed under the
+ * GNU GPL version 3. See LICENSE or <http://www.gnu.org/licenses/>
+ * for more information
+ */
+#ifndef _SEQUELJOE_FIXTURE_H_
+#define _SEQUELJOE_FIXTURE_H_
+
+#include "dbconnection.h"
+
+class QSettings;
+
+// A connection that can record table updates instead of running them, so
+// that the SQL a model generates can be timed on its own
+class BenchConnection : public DbConnection {
+    Q_OBJECT
+public:
+    explicit BenchConnection(const QSettings& settings) : DbConnection(settings), captureUpdates(false) {}
+
+    bool captureUpdates;
+    QString lastUpdate;
+
+    UpdateResult queryTableUpdate(QString query) override;
+};
+
+// A generated SQLite database with a single table of rows() rows. The file
+// is kept in the fixture directory and reused by later runs
+class Fixture {
+public:
+    enum Layout {
+        NARROW, // four short columns
+        WIDE    // 28 columns of mixed types, including long text and blobs
+    };
+
+    Fixture(Layout layout, int rows, QString dir);
+    ~Fixture();
+
+    // generates the database if there isn't one yet and connects to it
+    bool open(QString* error);
+
+    Layout layout() const { return lay; }
+    QString schemaName() const { return lay == NARROW ? "narrow" : "wide"; }
+    QString table() const { return schemaName(); }
+    int rows() const { return nRows; }
+    QString path() const;
+
+    BenchConnection& connection() { return *db; }
+
+private:
+    bool generate(QString file, QString* error);
+
+    Layout lay;
+    int nRows;
+    QString dir;
+    BenchConnection* db;
+};
+
+#endif // _SEQUELJOE_FIXTURE_H_
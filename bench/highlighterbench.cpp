@@ -0,0 +1,64 @@
+/*
+ * Copyright 2014 Oliver Giles
+ *
+ * This file is part of SequelJoe. SequelJoe is licensed under the
+ * GNU GPL version 3. See LICENSE or <http://www.gnu.org/licenses/>
+ * for more information
+ */
+#include "benchmark.h"
+#include "sqlhighlighter.h"
+
+#include <QTextBlock>
+#include <QTextCursor>
+#include <QTextDocument>
+
+// A script of about size bytes mixing the constructs the highlighter has to
+// track across blocks: strings, comments and statement boundaries
+static QString script(int size) {
+    static const char* statements[] = {
+        "SELECT id, name, COUNT(*) AS n FROM accounts a\n"
+        "  LEFT JOIN orders o ON o.account_id = a.id\n"
+        "  WHERE a.created > '2014-01-01' AND a.name NOT LIKE '%test%'\n"
+        "  GROUP BY id, name HAVING COUNT(*) > 10 ORDER BY n DESC LIMIT 100;\n",
+        "-- refresh the cached totals\n"
+        "UPDATE totals SET amount = amount + 12.5, note = 'it''s \"done\"' WHERE id IN (1, 2, 3);\n",
+        "/* a block comment\n   over several lines; with a ; inside\n*/\n"
+        "INSERT INTO log (level, message) VALUES (3, 'multi\nline; string');\n",
+        "CREATE TABLE IF NOT EXISTS items (id INTEGER PRIMARY KEY, label VARCHAR(64) NOT NULL,\n"
+        "  price DECIMAL(10,2) DEFAULT 0, data BLOB, updated TIMESTAMP);\n"
+    };
+    QString s;
+    s.reserve(size + 512);
+    for(int i = 0; s.length() < size; ++i)
+        s += statements[i % (sizeof(statements) / sizeof(*statements))];
+    return s;
+}
+
+void benchHighlighter(Benchmark& b, QList<int> scriptSizes) {
+    for(int size : scriptSizes) {
+        QTextDocument doc;
+        doc.setUndoRedoEnabled(false);
+        doc.setPlainText(script(size));
+        SqlHighlighter highlighter(&doc);
+
+        QJsonObject params;
+        params["scriptBytes"] = size;
+        params["blocks"] = doc.blockCount();
+        b.measure("highlighter.rehighlight", params, size, [&]{
+            highlighter.rehighlight();
+        });
+
+        // an edit is highlighted as it is made, up to the first following
+        // block whose state it leaves unchanged
+        QTextCursor cursor(doc.findBlockByNumber(doc.blockCount() / 2));
+        b.measure("highlighter.edit.local", params, 1, [&]{
+            cursor.insertText("x");
+            cursor.deletePreviousChar();
+        });
+        // an unbalanced quote changes the state of every block after it
+        b.measure("highlighter.edit.quote", params, 1, [&]{
+            cursor.insertText("'");
+            cursor.deletePreviousChar();
+        });
+    }
+}
@@ -0,0 +1,164 @@
+/*
+ * Copyright 2014 Oliver Giles
+ *
+ * This file is part of SequelJoe. SequelJoe is licensed under the
+ * GNU GPL version 3. See LICENSE or <http://www.gnu.org/licenses/>
+ * for more information
+ */
+#include "benchmark.h"
+#include "fixture.h"
+#include "dbconnection.h"
+#include "latencyproxy.h"
+#include "trace.h"
+
+#include <QApplication>
+#include <QCommandLineParser>
+#include <QDateTime>
+#include <QDir>
+#include <QFile>
+#include <QJsonDocument>
+#include <QSysInfo>
+#include <QTextStream>
+
+static QStringList splitList(QString s) {
+#if QT_VERSION >= QT_VERSION_CHECK(5, 14, 0)
+    return s.split(',', Qt::SkipEmptyParts);
+#else
+    return s.split(',', QString::SkipEmptyParts);
+#endif
+}
+
+static QList<int> intList(QString s) {
+    QList<int> list;
+    for(const QString& v : splitList(s))
+        list << v.toInt();
+    return list;
+}
+
+int main(int argc, char *argv[]) {
+    // the view benchmarks need widgets, but not a display
+    if(qEnvironmentVariableIsEmpty("QT_QPA_PLATFORM"))
+        qputenv("QT_QPA_PLATFORM", "offscreen");
+    QApplication a(argc, argv);
+    DbConnection::registerMetaTypes();
+    Trace::startFromEnvironment();
+
+    QCommandLineParser parser;
+    parser.setApplicationDescription("Times SequelJoe's data path against generated SQLite databases "
+                                     "and writes the results as JSON");
+    parser.addHelpOption();
+    QCommandLineOption output({"o", "output"}, "Write the results to <file> instead of stdout.", "file");
+    QCommandLineOption fixtures("fixtures", "Keep generated databases in <dir>, reusing them on later runs.", "dir",
+                                QDir::temp().filePath("sequeljoe-bench"));
+    QCommandLineOption rows("rows", "Comma-separated table sizes.", "rows", "10000,100000,1000000,10000000");
+    QCommandLineOption schemas("schemas", "Comma-separated table layouts: narrow, wide.", "schemas", "narrow,wide");
+    QCommandLineOption scripts("script-sizes", "Comma-separated sizes in bytes of the scripts to highlight.", "bytes", "1048576,8388608");
+    QCommandLineOption budget("budget", "Time each measurement for about <ms>.", "ms", "1000");
+    QCommandLineOption filter("filter", "Only run measurements whose name starts with one of these comma-separated prefixes.", "prefixes");
+    QCommandLineOption ssh("ssh", "Also time a tunnel through <user@host[:port]>. The password, if any, is read from SJ_BENCH_SSH_PASS.", "user@host");
+    QCommandLineOption sshKey("ssh-key", "Authenticate with the private key <file>.", "file");
+    QCommandLineOption echo("echo", "Echo service to tunnel to, as reached from the SSH server.", "host:port", "127.0.0.1:7");
+    QCommandLineOption payload("payload", "Megabytes to send through the tunnel.", "MB", "64");
+    QCommandLineOption acceptHost("accept-unknown-host", QString("Trust the SSH server's key if it isn't known yet. Needed with ") +
+                                  LinkShape::ENV_VAR + ", which puts the server behind a local port.");
+    QCommandLineOption proxy("proxy", QString("Instead of benchmarking, forward a local port to <host:port> over a link shaped by ") +
+                             LinkShape::ENV_VAR + ", e.g. rtt=200,jitter=20,rate=5mbit, until interrupted.", "host:port");
+    parser.addOptions({output, fixtures, rows, schemas, scripts, budget, filter, ssh, sshKey, echo, payload, acceptHost, proxy});
+    parser.process(a);
+
+    bool shapeOk;
+    LinkShape shape = LinkShape::parse(qgetenv(LinkShape::ENV_VAR), &shapeOk);
+    if(!shapeOk) {
+        QTextStream(stderr) << "invalid " << LinkShape::ENV_VAR << "\n";
+        return 1;
+    }
+    if(parser.isSet(proxy)) {
+        LatencyProxy p(parser.value(proxy).section(':', 0, 0).toLocal8Bit(), parser.value(proxy).section(':', 1).toInt(), shape);
+        QString error;
+        if(!p.listen(&error)) {
+            QTextStream(stderr) << "could not listen: " << error << "\n";
+            return 1;
+        }
+        QTextStream(stderr) << "forwarding 127.0.0.1:" << p.port() << " to " << parser.value(proxy) << " (" << shape.toString() << ")\n";
+        return a.exec();
+    }
+
+    Benchmark b(parser.value(budget).toInt());
+    b.setFilter(splitList(parser.value(filter)));
+    QTextStream err(stderr);
+    int status = 0;
+
+    if(b.enabled("driver") || b.enabled("model") || b.enabled("view")) {
+        QDir().mkpath(parser.value(fixtures));
+        bool quoted = false;
+        for(QString schema : splitList(parser.value(schemas))) {
+            for(int n : intList(parser.value(rows))) {
+                Fixture f(schema == "wide" ? Fixture::WIDE : Fixture::NARROW, n, parser.value(fixtures));
+                QString error;
+                if(!f.open(&error)) {
+                    err << "could not open " << f.path() << ": " << error << "\n";
+                    status = 1;
+                    continue;
+                }
+                benchDriver(b, f);
+                if(!quoted) {
+                    benchQuote(b, f);
+                    quoted = true;
+                }
+                benchModel(b, f);
+                benchView(b, f);
+            }
+        }
+    }
+
+    if(b.enabled("highlighter"))
+        benchHighlighter(b, intList(parser.value(scripts)));
+
+    if(parser.isSet(ssh) && b.enabled("tunnel")) {
+        TunnelTarget t;
+        QString user = parser.value(ssh).section('@', 0, -2);
+        QString server = parser.value(ssh).section('@', -1);
+        t.sshUser = user.toLocal8Bit();
+        t.sshHost = server.section(':', 0, 0).toLocal8Bit();
+        t.sshPort = server.contains(':') ? server.section(':', 1).toLocal8Bit() : QByteArray("22");
+        t.sshKeyPath = parser.value(sshKey).toLocal8Bit();
+        t.sshPass = qgetenv("SJ_BENCH_SSH_PASS");
+        t.echoHost = parser.value(echo).section(':', 0, 0).toLocal8Bit();
+        t.echoPort = parser.value(echo).section(':', 1).toInt();
+        t.acceptUnknownHost = parser.isSet(acceptHost);
+        t.payloadBytes = parser.value(payload).toLongLong() << 20;
+        t.shape = shape;
+        QString error;
+        if(!benchTunnel(b, t, &error)) {
+            err << "tunnel benchmark failed: " << error << "\n";
+            status = 1;
+        }
+    }
+
+    QJsonObject doc;
+    doc["timestamp"] = QDateTime::currentDateTimeUtc().toString(Qt::ISODate);
+    doc["qtVersion"] = QString(qVersion());
+    doc["os"] = QSysInfo::prettyProductName();
+    doc["cpu"] = QSysInfo::currentCpuArchitecture();
+#ifdef QT_NO_DEBUG
+    doc["build"] = QString("release");
+#else
+    doc["build"] = QString("debug");
+#endif
+    // connections to servers go through a shaped link when this is set
+    if(!shape.isNull())
+        doc["link"] = shape.toString();
+    doc["results"] = b.results();
+
+    QFile out;
+    if(parser.isSet(output))
+        out.setFileName(parser.value(output));
+    if(parser.isSet(output) ? !out.open(QIODevice::WriteOnly | QIODevice::Truncate) : !out.open(stdout, QIODevice::WriteOnly)) {
+        err << "could not write results: " << out.errorString() << "\n";
+        return 1;
+    }
+    out.write(QJsonDocument(doc).toJson());
+    if(Trace::isRecording())
+        Trace::stop();
+    return status;
+}
@@ -0,0 +1,161 @@
+/*
+ * Copyright 2014 Oliver Giles
+ *
+ * This file is part of SequelJoe. SequelJoe is licensed under the
+ * GNU GPL version 3. See LICENSE or <http://www.gnu.org/licenses/>
+ * for more information
+ */
+#include "benchmark.h"
+#include "fixture.h"
+#include "driver.h"
+#include "tablemodel.h"
+#include "tableview.h"
+#include "roles.h"
+
+#include <QCoreApplication>
+#include <QDateTime>
+#include <QEventLoop>
+#include <QSqlQuery>
+
+// results are accumulated here so that the timed calls can't be optimised away
+static volatile qint64 sink;
+
+// The fixture's connection lives on this thread, so the calls a model queues
+// to it run from the event loop. Returns once the model has its rows
+static void waitForSelect(SqlModel& m, std::function<void()> start) {
+    QEventLoop loop;
+    QMetaObject::Connection c = QObject::connect(&m, &SqlModel::selectFinished, &loop, &QEventLoop::quit);
+    start();
+    loop.exec();
+    QObject::disconnect(c);
+}
+
+static void loadPage(TableModel& m, int rowsPerPage) {
+    m.setRowsPerPage(rowsPerPage, false);
+    waitForSelect(m, [&]{ m.firstPage(); });
+}
+
+static QJsonObject withParam(QJsonObject params, QString key, QJsonValue value) {
+    params[key] = value;
+    return params;
+}
+
+void benchDriver(Benchmark& b, Fixture& f) {
+    Driver* driver = f.connection().sqlDriver();
+    QSqlQuery q(*driver);
+    b.measure("driver.countRows.table", fixtureParams(f), 1, [&]{
+        sink += driver->countRows(q);
+    }, [&]{
+        q = QSqlQuery(*driver);
+        q.exec("SELECT \"id\" FROM \"" + f.table() + "\"");
+    });
+    b.measure("driver.countRows.page", withParam(fixtureParams(f), "pageRows", 1000), 1, [&]{
+        sink += driver->countRows(q);
+    }, [&]{
+        q = QSqlQuery(*driver);
+        q.exec("SELECT * FROM \"" + f.table() + "\" LIMIT 1000");
+    });
+}
+
+void benchQuote(Benchmark& b, Fixture& f) {
+    enum { BATCH = 1000 };
+    Driver* driver = f.connection().sqlDriver();
+    QList<QPair<QString, QVariant>> values {
+        {"int", QVariant(qlonglong(1234567890123))},
+        {"double", QVariant(3.14159265358979)},
+        {"bool", QVariant(true)},
+        {"null", QVariant(QVariant::String)},
+        {"string", QVariant(QString("a short value"))},
+        {"escapedString", QVariant(QString("it's \"quoted\"\nover two lines"))},
+        {"longString", QVariant(QString(4096, 'x'))},
+        {"bytes", QVariant(QByteArray(64, '\xab'))},
+        {"dateTime", QVariant(QDateTime::fromMSecsSinceEpoch(1400000000000))}
+    };
+    for(const auto& v : values) {
+        b.measure("driver.quote." + v.first, QJsonObject(), BATCH, [&]{
+            for(int i = 0; i < BATCH; ++i)
+                sink += driver->quote(v.second).length();
+        });
+    }
+}
+
+void benchModel(Benchmark& b, Fixture& f) {
+    {
+        TableModel m(f.connection(), f.table());
+        waitForSelect(m, [&]{ m.describe(); });
+
+        for(int rows : {100, 1000}) {
+            m.setRowsPerPage(rows, false);
+            b.measure("model.select.first", withParam(fixtureParams(f), "pageRows", rows), 1, [&]{
+                waitForSelect(m, [&]{ m.firstPage(); });
+            });
+            b.measure("model.select.last", withParam(fixtureParams(f), "pageRows", rows), 1, [&]{
+                waitForSelect(m, [&]{ m.lastPage(); });
+            });
+        }
+
+        loadPage(m, 1000);
+        QList<QPair<QString, int>> roles {
+            {"display", Qt::DisplayRole},
+            {"edit", Qt::EditRole},
+            {"checkState", Qt::CheckStateRole},
+            {"editorType", EditorTypeRole},
+            {"valueTruncated", ValueTruncatedRole},
+            {"foreignKey", ForeignKeyRole}
+        };
+        int nRows = m.rowCount();
+        int nColumns = m.columnCount();
+        for(const auto& role : roles) {
+            b.measure("model.data." + role.first, withParam(fixtureParams(f), "pageRows", nRows), qint64(nRows) * nColumns, [&]{
+                for(int r = 0; r < nRows; ++r)
+                    for(int c = 0; c < nColumns; ++c)
+                        sink += m.data(m.index(r, c), role.second).isValid();
+            });
+        }
+
+        // unpaged, the first window comes through a cursor
+        m.setRowsPerPage(0, false);
+        b.measure("model.select.stream", fixtureParams(f), 1, [&]{
+            waitForSelect(m, [&]{ m.firstPage(); });
+        });
+        nRows = m.rowCount();
+        b.measure("model.data.display.streamed", withParam(fixtureParams(f), "pageRows", nRows), qint64(nRows) * nColumns, [&]{
+            for(int r = 0; r < nRows; ++r)
+                for(int c = 0; c < nColumns; ++c)
+                    sink += m.data(m.index(r, c), Qt::DisplayRole).isValid();
+        });
+    }
+
+    {
+        TableModel m(f.connection(), f.table());
+        waitForSelect(m, [&]{ m.describe(); });
+        loadPage(m, 100);
+        // an edit of a few columns in one row, keyed by the primary key
+        for(int c = 1; c < qMin(5, m.columnCount()); ++c)
+            m.setData(m.index(7, c), m.data(m.index(7, c), Qt::EditRole), Qt::EditRole);
+        f.connection().captureUpdates = true;
+        b.measure("model.submit.update", fixtureParams(f), 1, [&]{
+            // public in the base class
+            sink += static_cast<QAbstractItemModel&>(m).submit();
+        });
+        // the timed part ends with the update queued, don't run them all now
+        f.connection().jobs().clear();
+        f.connection().captureUpdates = false;
+    }
+    // e.g. cursors closed by the models' destructors
+    QCoreApplication::processEvents();
+}
+
+void benchView(Benchmark& b, Fixture& f) {
+    TableModel m(f.connection(), f.table());
+    waitForSelect(m, [&]{ m.describe(); });
+    loadPage(m, 1000);
+
+    TableView v;
+    v.resize(1200, 800);
+    v.setModel(&m);
+    QCoreApplication::processEvents();
+    b.measure("view.adjustColumnSizes", withParam(fixtureParams(f), "pageRows", m.rowCount()), 1, [&]{
+        v.adjustColumnSizes();
+    });
+}
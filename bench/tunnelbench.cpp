@@ -0,0 +1,165 @@
+/*
+ * Copyright 2014 Oliver Giles
+ *
+ * This file is part of SequelJoe. SequelJoe is licensed under the
+ * GNU GPL version 3. See LICENSE or <http://www.gnu.org/licenses/>
+ * for more information
+ */
+#ifdef _WIN32
+#include <winsock2.h>
+#else
+#include <sys/socket.h>
+#endif
+
+#include "benchmark.h"
+#include "connectionstats.h"
+#include "latencyproxy.h"
+#include "netutil.h"
+#include "savedconfig.h"
+#include "sshsessionpool.h"
+#include "sshthread.h"
+
+#include <QElapsedTimer>
+#include <QEventLoop>
+#include <QScopedPointer>
+#include <QTextStream>
+#include <thread>
+
+enum {
+    ROUND_TRIPS = 500,
+    PING_BYTES = 64,
+    CHUNK_BYTES = 64 * 1024
+};
+
+static bool sendAll(int fd, const char* data, qint64 length) {
+    while(length > 0) {
+        int n = ::send(fd, data, int(qMin<qint64>(length, CHUNK_BYTES)), 0);
+        if(n <= 0)
+            return false;
+        data += n;
+        length -= n;
+    }
+    return true;
+}
+
+static bool recvAll(int fd, char* data, qint64 length) {
+    while(length > 0) {
+        int n = ::recv(fd, data, int(qMin<qint64>(length, CHUNK_BYTES)), 0);
+        if(n <= 0)
+            return false;
+        data += n;
+        length -= n;
+    }
+    return true;
+}
+
+// Round trips and bulk transfer through a tunnel to an echo service, e.g.
+// `socat TCP-LISTEN:7,fork EXEC:cat` running on or behind the SSH server
+bool benchTunnel(Benchmark& b, const TunnelTarget& t, QString* error) {
+    SshParams params;
+    params.sshHost = t.sshHost;
+    params.sshPort = t.sshPort;
+    params.sshUser = t.sshUser;
+    params.useSshKey = !t.sshKeyPath.isEmpty();
+    params.sshKeyPath = t.sshKeyPath;
+    params.sshPass = t.sshPass;
+    params.remoteHost = t.echoHost;
+    params.remotePort = t.echoPort;
+    params.compress = false;
+    params.windowSize = SavedConfig::DEFAULT_SSH_WINDOW_SIZE;
+    params.packetSize = SavedConfig::DEFAULT_SSH_PACKET_SIZE;
+    params.unixSocket = false;
+    params.connectTimeout = SavedConfig::DEFAULT_SSH_CONNECT_TIMEOUT;
+
+    QJsonObject target;
+    target["sshHost"] = QString(t.sshHost);
+    target["echo"] = QString(t.echoHost) + ":" + QString::number(t.echoPort);
+
+    // the SSH connection is the one that would cross a slow network
+    QScopedPointer<LatencyProxy> link;
+    if(!t.shape.isNull()) {
+        link.reset(new LatencyProxy(t.sshHost, t.sshPort.toInt(), t.shape));
+        if(!link->listen(error))
+            return false;
+        params.sshHost = "127.0.0.1";
+        params.sshPort = QByteArray::number(link->port());
+        target["link"] = t.shape.toString();
+    }
+
+    TunnelStats stats;
+    QElapsedTimer timer;
+    timer.start();
+    SshTunnel* tunnel = SshSessionPool::instance().acquire(params, stats);
+
+    QEventLoop loop;
+    QString host;
+    int port = 0;
+    QObject::connect(tunnel, &SshTunnel::opened, &loop, [&](QString h, int p){ host = h; port = p; loop.quit(); });
+    QObject::connect(tunnel, &SshTunnel::failed, &loop, [&](QString reason){ *error = reason; loop.quit(); });
+    QObject::connect(tunnel, &SshTunnel::confirmUnknownHost, &loop, [&](QString fingerprint, bool* ok){
+        QTextStream(stderr) << "unknown host key " << fingerprint << (t.acceptUnknownHost ? ", accepted\n" : ", rejected\n");
+        *ok = t.acceptUnknownHost;
+    }, Qt::BlockingQueuedConnection);
+    tunnel->open();
+    loop.exec();
+    if(port == 0) {
+        SshSessionPool::instance().release(tunnel);
+        return false;
+    }
+    b.record("tunnel.connect", target, 1, 1, timer.nsecsElapsed());
+
+    int fd = connectTcp(host.toLocal8Bit().constData(), QByteArray::number(port).constData(),
+                        SavedConfig::DEFAULT_SSH_CONNECT_TIMEOUT, error);
+    if(fd == -1) {
+        SshSessionPool::instance().release(tunnel);
+        return false;
+    }
+
+    bool ok = true;
+    if(b.enabled("tunnel.roundTrip")) {
+        QByteArray ping(PING_BYTES, 'p');
+        QByteArray pong(PING_BYTES, 0);
+        timer.start();
+        for(int i = 0; ok && i < ROUND_TRIPS; ++i)
+            ok = sendAll(fd, ping.constData(), ping.size()) && recvAll(fd, pong.data(), pong.size());
+        if(ok)
+            b.record("tunnel.roundTrip", target, ROUND_TRIPS, 1, timer.nsecsElapsed());
+    }
+
+    if(ok && b.enabled("tunnel.throughput")) {
+        // written from another thread so that the echo never backs up
+        QByteArray chunk(CHUNK_BYTES, 'd');
+        bool sent = true;
+        quint64 stallsBefore = stats.windowStalls.load();
+        quint64 spinsBefore = stats.eagainSpins.load();
+        timer.start();
+        std::thread writer([&]{
+            for(qint64 left = t.payloadBytes; sent && left > 0; left -= CHUNK_BYTES)
+                sent = sendAll(fd, chunk.constData(), qMin<qint64>(left, CHUNK_BYTES));
+        });
+        QByteArray echo(CHUNK_BYTES, 0);
+        for(qint64 left = t.payloadBytes; ok && left > 0; left -= CHUNK_BYTES)
+            ok = recvAll(fd, echo.data(), qMin<qint64>(left, CHUNK_BYTES));
+        qint64 nsecs = timer.nsecsElapsed();
+        if(!ok)
+            ::shutdown(fd, 2);
+        writer.join();
+        ok = ok && sent;
+        if(ok) {
+            QJsonObject extra;
+            extra["megabytesPerSec"] = 2.0 * t.payloadBytes / (nsecs / 1e9) / (1 << 20);
+            extra["windowStalls"] = double(stats.windowStalls.load() - stallsBefore);
+            extra["eagainSpins"] = double(stats.eagainSpins.load() - spinsBefore);
+            QJsonObject p = target;
+            p["payloadBytes"] = double(t.payloadBytes);
+            // each byte goes out and comes back
+            b.record("tunnel.throughput", p, 1, 2 * t.payloadBytes, nsecs, extra);
+        }
+    }
+    if(!ok)
+        *error = "echo connection closed early";
+
+    closeSocket(fd);
+    SshSessionPool::instance().release(tunnel);
+    return ok;
+}
@@ -0,0 +1,279 @@
+/*
+ * Copyright 2014 Oliver Giles
+ *
+ * This file is part of SequelJoe. SequelJoe is licensed under the
+ * GNU GPL version 3. See LICENSE or <http://www.gnu.org/licenses/>
+ * for more information
+ */
+#include "binarycelleditor.h"
+#include "tablemodel.h"
+#include "fontmetrics.h"
+
+#include <QAbstractScrollArea>
+#include <QScrollBar>
+#include <QPainter>
+#include <QVBoxLayout>
+#include <QHBoxLayout>
+#include <QLabel>
+#include <QPushButton>
+#include <QFile>
+#include <QFileDialog>
+#include <QMessageBox>
+#include <functional>
+
+// Paints only the visible lines, from chunks fetched on demand. Chunks far
+// from the view are dropped so memory stays bounded however large the value
+class HexView : public QAbstractScrollArea {
+public:
+    enum { BYTES_PER_LINE = 16, CHUNK_SIZE = 64 * 1024, MAX_CHUNKS = 64 };
+
+    explicit HexView(QWidget* parent = 0) :
+        QAbstractScrollArea(parent),
+        size(0)
+    {
+        QFont fnt("monospace");
+        fnt.setStyleHint(QFont::TypeWriter);
+        setFont(fnt);
+    }
+
+    void reset(qint64 bytes) {
+        size = bytes;
+        chunks.clear();
+        requested.clear();
+        requests.clear();
+        updateScrollBar();
+        viewport()->update();
+    }
+
+    // returns the offset of the chunk, or -1 if the request wasn't made by
+    // this view or failed. A failed chunk is asked for again when next painted
+    qint64 addChunk(int request, const QByteArray& data) {
+        auto it = requests.find(request);
+        if(it == requests.end())
+            return -1;
+        qint64 chunk = it.value();
+        requests.erase(it);
+        requested.remove(chunk);
+        if(data.isNull() || data.size() > CHUNK_SIZE)
+            return -1;
+        chunks.insert(chunk, data);
+        evict();
+        viewport()->update();
+        return chunk * CHUNK_SIZE;
+    }
+
+    // returns the request id, or -1 if the chunk can't be fetched
+    std::function<int(qint64 offset, int length)> fetch;
+
+protected:
+    void paintEvent(QPaintEvent*) override {
+        QPainter p(viewport());
+        QFontMetrics fm(font());
+        int lineHeight = fm.height();
+        int digit = horizontalAdvance(fm, "0");
+        int hexX = digit * 10;
+        int asciiX = hexX + digit * (BYTES_PER_LINE * 3 + 1);
+        qint64 firstLine = verticalScrollBar()->value();
+        int nLines = viewport()->height() / lineHeight + 1;
+
+        for(int i = 0; i < nLines; ++i) {
+            qint64 offset = (firstLine + i) * BYTES_PER_LINE;
+            if(offset >= size)
+                break;
+            int y = i * lineHeight + fm.ascent();
+            p.setPen(palette().color(QPalette::Disabled, QPalette::Text));
+            p.drawText(0, y, QString("%1").arg(offset, 8, 16, QChar('0')));
+            p.setPen(palette().color(QPalette::Text));
+
+            const QByteArray* data = chunkFor(offset);
+            if(!data) {
+                p.drawText(hexX, y, QString(QChar(0x2026)));
+                continue;
+            }
+            int from = offset % CHUNK_SIZE;
+            int n = qMin<qint64>(BYTES_PER_LINE, qMin<qint64>(size - offset, data->size() - from));
+            QString hex, ascii;
+            for(int b = 0; b < n; ++b) {
+                uchar c = data->at(from + b);
+                hex += QString("%1 ").arg(c, 2, 16, QChar('0'));
+                ascii += (c >= 0x20 && c < 0x7f) ? QChar(c) : QChar('.');
+            }
+            p.drawText(hexX, y, hex);
+            p.drawText(asciiX, y, ascii);
+        }
+    }
+
+    void resizeEvent(QResizeEvent* e) override {
+        QAbstractScrollArea::resizeEvent(e);
+        updateScrollBar();
+    }
+
+private:
+    const QByteArray* chunkFor(qint64 offset) {
+        qint64 chunk = offset / CHUNK_SIZE;
+        auto it = chunks.constFind(chunk);
+        if(it != chunks.constEnd())
+            return &it.value();
+        if(!requested.contains(chunk) && fetch) {
+            int request = fetch(chunk * CHUNK_SIZE, CHUNK_SIZE);
+            if(request != -1) {
+                requested.insert(chunk);
+                requests.insert(request, chunk);
+            }
+        }
+        return nullptr;
+    }
+
+    void evict() {
+        qint64 current = verticalScrollBar()->value() * BYTES_PER_LINE / CHUNK_SIZE;
+        while(chunks.count() > MAX_CHUNKS) {
+            auto furthest = chunks.begin();
+            for(auto it = chunks.begin(); it != chunks.end(); ++it) {
+                if(qAbs(it.key() - current) > qAbs(furthest.key() - current))
+                    furthest = it;
+            }
+            chunks.erase(furthest);
+        }
+    }
+
+    void updateScrollBar() {
+        int lineHeight = QFontMetrics(font()).height();
+        qint64 lines = (size + BYTES_PER_LINE - 1) / BYTES_PER_LINE;
+        int visible = viewport()->height() / lineHeight;
+        verticalScrollBar()->setRange(0, qMax<qint64>(0, lines - visible));
+        verticalScrollBar()->setPageStep(visible);
+    }
+
+    qint64 size;
+    QHash<qint64, QByteArray> chunks;
+    QSet<qint64> requested;
+    // request id to chunk
+    QHash<int, qint64> requests;
+};
+
+BinaryCellEditor::BinaryCellEditor(QWidget *parent) :
+    QDialog(parent),
+    model(nullptr),
+    size(0),
+    saveFile(nullptr),
+    saveOffset(0),
+    saveRequest(-1)
+{
+    setModal(true);
+    setWindowTitle("View Binary");
+    QBoxLayout* l = new QVBoxLayout(this);
+    view = new HexView(this);
+    view->fetch = [this](qint64 offset, int length) {
+        return model ? model->fetchChunk(index, offset, length) : -1;
+    };
+    l->addWidget(view);
+
+    QBoxLayout* bottom = new QHBoxLayout();
+    info = new QLabel(this);
+    bottom->addWidget(info, 1);
+    saveButton = new QPushButton("Save to File...", this);
+    connect(saveButton, SIGNAL(clicked()), this, SLOT(save()));
+    bottom->addWidget(saveButton);
+    l->addLayout(bottom);
+}
+
+BinaryCellEditor::~BinaryCellEditor() {
+    delete saveFile;
+}
+
+void BinaryCellEditor::setSource(TableModel* m, const QModelIndex& idx) {
+    // called again whenever the cell's data changes, which doesn't affect us
+    if(m == model && idx == index)
+        return;
+    if(model)
+        disconnect(model, 0, this, 0);
+    finishSave("The value has changed");
+    model = m;
+    index = idx;
+    size = model ? qMax<qint64>(model->valueLength(idx), 0) : 0;
+    if(model)
+        connect(model, SIGNAL(chunkReady(int,QByteArray)), this, SLOT(chunkReady(int,QByteArray)));
+    info->setText(QString::number(size) + " bytes");
+    view->reset(size);
+}
+
+QString BinaryCellEditor::detectFormat(const QByteArray& data) {
+    static const struct { const char* magic; int length; const char* name; } formats[] = {
+        { "\x89PNG\r\n\x1a\n", 8, "PNG image" },
+        { "\xff\xd8\xff", 3, "JPEG image" },
+        { "GIF87a", 6, "GIF image" },
+        { "GIF89a", 6, "GIF image" },
+        { "RIFF", 4, "RIFF container" },
+        { "%PDF", 4, "PDF document" },
+        { "\x1f\x8b", 2, "gzip compressed" },
+        { "BZh", 3, "bzip2 compressed" },
+        { "\x28\xb5\x2f\xfd", 4, "zstd compressed" },
+        { "\xfd" "7zXZ", 6, "xz compressed" },
+        { "PK\x03\x04", 4, "zip archive" },
+        { "SQLite format 3", 15, "SQLite database" },
+    };
+    for(const auto& f : formats) {
+        if(data.startsWith(QByteArray::fromRawData(f.magic, f.length)))
+            return f.name;
+    }
+    return QString();
+}
+
+void BinaryCellEditor::chunkReady(int request, QByteArray data) {
+    // the view and the save fetch chunks of different sizes, each only gets
+    // the ones it asked for
+    if(view->addChunk(request, data) == 0 && !saveFile) {
+        QString format = detectFormat(data);
+        info->setText(QString::number(size) + " bytes" + (format.isEmpty() ? "" : ", " + format));
+    }
+
+    if(saveFile && request == saveRequest) {
+        saveRequest = -1;
+        if(data.isNull())
+            return finishSave("Could not read the value from the server");
+        if(saveFile->write(data) != data.size())
+            return finishSave(saveFile->errorString());
+        saveOffset += data.size();
+        info->setText("Saving... " + QString::number(100 * saveOffset / qMax<qint64>(size, 1)) + "%");
+        if(saveOffset >= size || data.isEmpty())
+            return finishSave();
+        saveRequest = model->fetchChunk(index, saveOffset, SAVE_CHUNK_SIZE);
+        if(saveRequest == -1)
+            finishSave("The value is no longer available");
+    }
+}
+
+void BinaryCellEditor::save() {
+    // the button cancels a save in progress
+    if(saveFile)
+        return finishSave("Cancelled");
+
+    QString path = QFileDialog::getSaveFileName(this, "Save Value");
+    if(path.isEmpty() || !model)
+        return;
+    saveFile = new QFile(path);
+    if(!saveFile->open(QIODevice::WriteOnly))
+        return finishSave(saveFile->errorString());
+    saveOffset = 0;
+    saveButton->setText("Cancel");
+    if(size == 0)
+        return finishSave();
+    saveRequest = model->fetchChunk(index, 0, SAVE_CHUNK_SIZE);
+    if(saveRequest == -1)
+        finishSave("The value is no longer available");
+}
+
+void BinaryCellEditor::finishSave(QString error) {
+    if(!saveFile)
+        return;
+    saveFile->close();
+    if(!error.isNull()) {
+        saveFile->remove();
+        QMessageBox::warning(this, "Save failed", error);
+    }
+    delete saveFile;
+    saveFile = nullptr;
+    saveRequest = -1;
+    saveButton->setText("Save to File...");
+    info->setText(QString::number(size) + " bytes");
+}
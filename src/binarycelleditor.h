@@ -0,0 +1,59 @@
+/*
+ * Copyright 2014 Oliver Giles
+ *
+ * This file is part of SequelJoe. SequelJoe is licensed under the
+ * GNU GPL version 3. See LICENSE or <http://www.gnu.org/licenses/>
+ * for more information
+ */
+#ifndef _SEQUELJOE_BINARYCELLEDITOR_H_
+#define _SEQUELJOE_BINARYCELLEDITOR_H_
+
+#include <QDialog>
+#include <QPersistentModelIndex>
+
+class TableModel;
+class HexView;
+class QLabel;
+class QPushButton;
+class QFile;
+
+// Read-only hex view of a binary value. The value is never loaded whole:
+// the visible part is fetched from the server in chunks as it scrolls into
+// view, and saving to a file streams it chunk by chunk.
+class BinaryCellEditor : public QDialog
+{
+    Q_OBJECT
+public:
+    explicit BinaryCellEditor(QWidget *parent = 0);
+    virtual ~BinaryCellEditor();
+    QSize sizeHint() const override { return QSize(640,400); }
+
+    // the editor only works with values fetched as a prefix by a TableModel,
+    // see TableModel::valueLength
+    void setSource(TableModel* model, const QModelIndex& index);
+
+    // a short description of the format of data by its magic bytes, if known
+    static QString detectFormat(const QByteArray& data);
+
+private slots:
+    void chunkReady(int request, QByteArray data);
+    void save();
+
+private:
+    void finishSave(QString error = QString());
+
+    enum { SAVE_CHUNK_SIZE = 1 << 20 };
+
+    TableModel* model;
+    QPersistentModelIndex index;
+    qint64 size;
+    HexView* view;
+    QLabel* info;
+    QPushButton* saveButton;
+    QFile* saveFile;
+    qint64 saveOffset;
+    // the model's id for the save chunk in flight, -1 if none
+    int saveRequest;
+};
+
+#endif // _SEQUELJOE_BINARYCELLEDITOR_H_
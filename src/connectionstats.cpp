@@ -0,0 +1,51 @@
+/*
+ * Copyright 2014 Oliver Giles
+ *
+ * This file is part of SequelJoe. SequelJoe is licensed under the
+ * GNU GPL version 3. See LICENSE or <http://www.gnu.org/licenses/>
+ * for more information
+ */
+#include "connectionstats.h"
+
+#include <QVariant>
+
+void TunnelStats::sampleRtt(qint64 micros) {
+    // smooth like TCP's SRTT, a single slow reply shouldn't dominate
+    int old = rttMicros.load();
+    rttMicros.store(old == 0 ? int(micros) : int((7 * qint64(old) + micros) / 8));
+}
+
+QJsonObject TunnelStats::toJson() const {
+    QJsonObject o;
+    o["bytesIn"] = double(bytesIn.load());
+    o["bytesOut"] = double(bytesOut.load());
+    o["windowStalls"] = double(windowStalls.load());
+    o["eagainSpins"] = double(eagainSpins.load());
+    o["reconnects"] = double(reconnects.load());
+    o["forwards"] = forwards.load();
+    o["rttMs"] = rttMicros.load() / 1000.0;
+    return o;
+}
+
+QJsonObject QueryStats::toJson() const {
+    QJsonObject o;
+    o["queries"] = double(queries.load());
+    o["errors"] = double(errors.load());
+    o["rowsFetched"] = double(rowsFetched.load());
+    o["bytesFetched"] = double(bytesFetched.load());
+    o["queryMs"] = queryMicros.load() / 1000.0;
+    return o;
+}
+
+qint64 valueBytes(const QVariant& v) {
+    switch(v.type()) {
+    case QVariant::Invalid:
+        return 0;
+    case QVariant::String:
+        return v.toString().size();
+    case QVariant::ByteArray:
+        return v.toByteArray().size();
+    default:
+        return 8;
+    }
+}
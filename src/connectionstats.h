@@ -0,0 +1,44 @@
+/*
+ * Copyright 2014 Oliver Giles
+ *
+ * This file is part of SequelJoe. SequelJoe is licensed under the
+ * GNU GPL version 3. See LICENSE or <http://www.gnu.org/licenses/>
+ * for more information
+ */
+#ifndef _SEQUELJOE_CONNECTIONSTATS_H_
+#define _SEQUELJOE_CONNECTIONSTATS_H_
+
+#include <QAtomicInteger>
+#include <QJsonObject>
+
+// Traffic counters for an SSH tunnel. Updated by the tunnel thread and read
+// from the GUI thread, so every field is atomic and may be read at any time
+struct TunnelStats {
+    QAtomicInteger<quint64> bytesIn;   // received from the server's channels
+    QAtomicInteger<quint64> bytesOut;  // written to the server's channels
+    QAtomicInteger<quint64> windowStalls; // writes held up by a full remote window
+    QAtomicInteger<quint64> eagainSpins;  // wakeups after which nothing could move
+    QAtomicInteger<quint64> reconnects;
+    QAtomicInt forwards;   // open local connections
+    QAtomicInt rttMicros;  // smoothed keepalive round trip, 0 until measured
+
+    void sampleRtt(qint64 micros);
+    QJsonObject toJson() const;
+};
+
+// Counters for the statements a DbConnection runs, updated on the worker
+// thread and read from the GUI thread
+struct QueryStats {
+    QAtomicInteger<quint64> queries;
+    QAtomicInteger<quint64> errors;
+    QAtomicInteger<quint64> rowsFetched;
+    QAtomicInteger<quint64> bytesFetched; // estimated from the fetched values
+    QAtomicInteger<quint64> queryMicros;  // total time spent executing
+
+    QJsonObject toJson() const;
+};
+
+// rough in-memory size of a fetched value
+qint64 valueBytes(const QVariant& v);
+
+#endif // _SEQUELJOE_CONNECTIONSTATS_H_
@@ -100,6 +100,17 @@ ConnectionWidget::ConnectionWidget(QWidget *parent) :
             sshPassKey = new PassKeyWidget(boxSsh);
             sshForm->addRow("Password", sshPassKey);
 
+            // costs CPU, but worth it over slow links
+            sshCompress = new QCheckBox("Compress traffic", boxSsh);
+            sshForm->addRow("", sshCompress);
+
+            // only MySQL and PostgreSQL can use it, others stay on TCP
+            sshUnixSocket = new QCheckBox("Use a local socket", boxSsh);
+#ifdef _WIN32
+            sshUnixSocket->setEnabled(false);
+#endif
+            sshForm->addRow("", sshUnixSocket);
+
             //boxSsh->hide();
         }
 
@@ -126,6 +137,8 @@ ConnectionWidget::ConnectionWidget(QWidget *parent) :
     connect(sshPort, SIGNAL(textEdited(QString)), this, SLOT(setupSshPortChanged(QString)));
     connect(sshUsername, SIGNAL(textEdited(QString)), this, SLOT(setupSshUserChanged(QString)));
     connect(sshPassKey, SIGNAL(changed(bool,QString)), this, SLOT(setupSshPassKeyChanged(bool,QString)));
+    connect(sshCompress, SIGNAL(toggled(bool)), this, SLOT(setupSshCompressChanged(bool)));
+    connect(sshUnixSocket, SIGNAL(toggled(bool)), this, SLOT(setupSshUnixSocketChanged(bool)));
 
     favourites->populateFromConfig();
 }
@@ -278,6 +291,20 @@ void ConnectionWidget::setupSshPassKeyChanged(bool key, QString value) {
     s.endGroup();
 }
 
+void ConnectionWidget::setupSshCompressChanged(bool compress) {
+    QSettings s;
+    s.beginGroup(group);
+    s.setValue(SavedConfig::KEY_SSH_COMPRESS, compress);
+    s.endGroup();
+}
+
+void ConnectionWidget::setupSshUnixSocketChanged(bool unixSocket) {
+    QSettings s;
+    s.beginGroup(group);
+    s.setValue(SavedConfig::KEY_SSH_UNIX_SOCKET, unixSocket);
+    s.endGroup();
+}
+
 bool ConnectionWidget::dbTypeIsFile(int type) const {
     return sqlType->model()->data(sqlType->model()->index(type,0), DatabaseIsFileRole).toBool();
 }
@@ -310,5 +337,7 @@ void ConnectionWidget::loadSettings(QString groupName) {
         sshPassKey->setValue(true, s.value(SavedConfig::KEY_SSH_KEY).toString());
     else
         sshPassKey->setValue(false, s.value(SavedConfig::KEY_SSH_PASS).toString());
+    sshCompress->setChecked(s.value(SavedConfig::KEY_SSH_COMPRESS).toBool());
+    sshUnixSocket->setChecked(s.value(SavedConfig::KEY_SSH_UNIX_SOCKET).toBool());
     s.endGroup();
 }
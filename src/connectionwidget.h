@@ -49,6 +49,8 @@ private slots:
     void setupSshPortChanged(QString);
     void setupSshUserChanged(QString);
     void setupSshPassKeyChanged(bool, QString);
+    void setupSshCompressChanged(bool);
+    void setupSshUnixSocketChanged(bool);
     void connectButtonClicked();
 
 private:
@@ -71,6 +73,8 @@ private:
     QLineEdit* sshPort;
     QLineEdit* sshUsername;
     PassKeyWidget* sshPassKey;
+    QCheckBox* sshCompress;
+    QCheckBox* sshUnixSocket;
     QPushButton* connectButton;
     Favourites* favourites;
 };
@@ -7,11 +7,11 @@
  */
 #include "dbconnection.h"
 
-#include "schemamodel.h"
-#include "sqlmodel.h"
-#include "notify.h"
 #include "savedconfig.h"
 #include "sshthread.h"
+#include "sshsessionpool.h"
+#include "latencyproxy.h"
+#include "trace.h"
 #include "driver.h"
 #include "tabledata.h"
 
@@ -23,13 +23,26 @@
 #include <QStringList>
 #include <QThread>
 #include <QSqlError>
-#include <QApplication>
 #include <QSqlRecord>
+#include <QSqlField>
+#include <QElapsedTimer>
+#include <QDateTime>
 
 int DbConnection::nConnections = 0;
 
+void DbConnection::registerMetaTypes() {
+    qRegisterMetaType<ForeignKey>("ForeignKey");
+}
+
+static bool superseded(const QAtomicInt* latest, int generation) {
+    return latest && latest->load() != generation;
+}
+
 DbConnection::DbConnection(const QSettings &settings) {
-    tunnel = {0,0};
+    tunnel = nullptr;
+    linkProxy = nullptr;
+    jobQueue = new JobQueue(this);
+    driverGeneration = 0;
 
     sqlParams.host = settings.value(SavedConfig::KEY_HOST).toByteArray();
     sqlParams.port = settings.value(SavedConfig::KEY_PORT).toInt();
@@ -53,19 +66,23 @@ DbConnection::DbConnection(const QSettings &settings) {
         sshParams.useSshKey = settings.contains(SavedConfig::KEY_SSH_KEY);
         sshParams.sshKeyPath = settings.value(SavedConfig::KEY_SSH_KEY).toByteArray();
         sshParams.sshPass = settings.value(SavedConfig::KEY_SSH_PASS).toByteArray();
+        sshParams.compress = settings.value(SavedConfig::KEY_SSH_COMPRESS).toBool();
+        sshParams.windowSize = settings.value(SavedConfig::KEY_SSH_WINDOW_SIZE, SavedConfig::DEFAULT_SSH_WINDOW_SIZE).toUInt();
+        sshParams.packetSize = settings.value(SavedConfig::KEY_SSH_PACKET_SIZE, SavedConfig::DEFAULT_SSH_PACKET_SIZE).toUInt();
+        sshParams.unixSocket = settings.value(SavedConfig::KEY_SSH_UNIX_SOCKET).toBool();
+        sshParams.connectTimeout = settings.value(SavedConfig::KEY_SSH_CONNECT_TIMEOUT, SavedConfig::DEFAULT_SSH_CONNECT_TIMEOUT).toInt();
     }
 
     driver = Driver::createDriver(sqlParams.driverName);
+    if(useSshTunnel && sshParams.unixSocket)
+        sshParams.socketName = driver->unixSocketName(sqlParams.port).toLocal8Bit();
 }
 
 DbConnection::~DbConnection() {
     delete driver;
-    delete tunnel.ssh;
-    if(tunnel.thread) {
-        tunnel.thread->exit();
-        tunnel.thread->wait();
-        delete tunnel.thread;
-    }
+    delete linkProxy;
+    if(tunnel)
+        SshSessionPool::instance().release(tunnel);
 }
 
 QStringList DbConnection::tables() const {
@@ -73,6 +90,8 @@ QStringList DbConnection::tables() const {
 }
 
 void DbConnection::cleanup() {
+    if(!driver->isValid())
+        return; // already done
     QString name = driver->connectionName();
     driver->close();
     *((QSqlDatabase*) driver) = QSqlDatabase{};
@@ -87,34 +106,158 @@ QSqlQueryModel* DbConnection::query(QString q, QSqlQueryModel* update) {
 }
 
 int DbConnection::execQuery(QSqlQuery& q) const {
+    TraceSpan span("execQuery", "db");
+    QElapsedTimer timer;
+    timer.start();
     q.exec();
+    // the server connection may have died with the network, e.g. when the
+    // SSH tunnel had to reconnect. Reads are safe to repeat, so try once more
+    if(q.lastError().isValid() && driver->isConnectionLost(q.lastError()) && Driver::isSelectStatement(q.lastQuery()) && reopen()) {
+        q.prepare(q.lastQuery());
+        q.exec();
+    }
+    queryStats.queries.ref();
+    queryStats.queryMicros.fetchAndAddRelaxed(timer.nsecsElapsed() / 1000);
     QString msg;
     int nRows = 0;
     if(q.lastError().isValid()) {
+        queryStats.errors.ref();
         msg = "Error: " + q.lastError().text();
     } else {
         if(q.isSelect()) {
             nRows = driver->countRows(q);
+            queryStats.rowsFetched.fetchAndAddRelaxed(nRows);
             msg = QString::number(nRows) + " rows retrieved";
         } else {
             nRows = q.numRowsAffected();
             msg = QString::number(nRows) + " rows affected";
         }
     }
-    if(qApp->focusWindow() == 0) {
-        Notifier::instance()->send("Query complete", msg.toLocal8Bit().constData());
-    }
+    statementRan(q.isSelect());
+    span.setArg("query", q.lastQuery().left(256));
+    span.setArg("result", msg);
     emit queryExecuted(q.lastQuery(), msg);
     return nRows;
 }
 
-void DbConnection::queryTableMetadata(QString tableName, QObject* callbackOwner, const char* callbackName) {
-    QMetaObject::invokeMethod(callbackOwner, callbackName, Qt::QueuedConnection, Q_ARG(TableMetadata, driver->metadata(tableName)));
+void DbConnection::statementRan(bool isSelect) const {
+    // anything but a select may have changed rows we hold for foreign key
+    // previews
+    if(!isSelect)
+        foreignRows.clear();
+}
+
+void DbConnection::countFetched(const ResultRows& rows) const {
+    qint64 bytes = 0;
+    for(const QVector<QVariant>& row : rows) {
+        for(const QVariant& v : row)
+            bytes += valueBytes(v);
+    }
+    queryStats.rowsFetched.fetchAndAddRelaxed(rows.count());
+    queryStats.bytesFetched.fetchAndAddRelaxed(bytes);
+}
+
+QJsonObject DbConnection::statsSnapshot() const {
+    QJsonObject o;
+    o["time"] = QDateTime::currentDateTimeUtc().toString(Qt::ISODate);
+    o["driver"] = sqlParams.driverName;
+    o["connection"] = queryStats.toJson();
+    if(useSshTunnel)
+        o["tunnel"] = tunnelStats.toJson();
+    return o;
+}
+
+// Opens the driver connection again, after waiting for the SSH tunnel to be
+// re-established if it went down
+bool DbConnection::reopen() const {
+    if(useSshTunnel) {
+        if(!tunnel->waitForSession(RECONNECT_TIMEOUT))
+            return false;
+        driverGeneration = tunnel->sessionGeneration();
+    }
+    driver->close();
+    return driver->open();
+}
+
+void DbConnection::tunnelLost(QString reason) {
+    emit queryExecuted(QString(), "SSH connection lost (" + reason + "), reconnecting");
+}
+
+void DbConnection::tunnelRestored() {
+    emit queryExecuted(QString(), "SSH connection restored");
+    // a query may already have reopened it while waiting for the tunnel
+    if(driverGeneration != tunnel->sessionGeneration() && !reopen())
+        emit queryExecuted(QString(), "Error: " + driver->lastError().text());
+}
+
+QString DbConnection::cursorName(const QSqlQuery* cursor) {
+    return "sj_cursor_" + QString::number(quintptr(cursor), 16);
+}
+
+TableMetadata DbConnection::queryTableMetadata(QString tableName) {
+    TraceSpan span("Driver::metadata", "db");
+    span.setArg("table", tableName);
+    return driver->metadata(tableName);
+}
+
+// Display width of a value in characters, as SqlModel::data would show it
+static int displayLength(const QVariant& v) {
+    if(v.isNull())
+        return 4; // "null"
+    if(v.type() == QVariant::String) {
+        QString s = v.toString();
+        return s.length() - s.count('\n');
+    }
+    return v.toString().length();
 }
 
-void DbConnection::queryTableContent(QSqlQuery* query, QObject* callbackOwner, const char* callbackName) {
-    int nRows = execQuery(*query);
-    QMetaObject::invokeMethod(callbackOwner, callbackName, Qt::QueuedConnection, Q_ARG(int, nRows));
+// The views size their columns from these estimates instead of measuring
+// every cell on the GUI thread. A sample of rows is plenty for that, and
+// anything wider than COLUMN_SAMPLE_MAX_CHARS is clipped by the view anyway
+static const int COLUMN_SAMPLE_ROWS = 64;
+static const int COLUMN_SAMPLE_MAX_CHARS = 64;
+
+// also returns the size of the whole page, which is read in anyway
+static qint64 sampleColumnWidths(QSqlQuery& q, int nRows, QVector<int>& widths) {
+    int nColumns = q.record().count();
+    widths.fill(0, nColumns);
+    int stride = qMax(1, nRows / COLUMN_SAMPLE_ROWS);
+    qint64 bytes = 0;
+    for(int row = 0; row < nRows && q.seek(row); ++row) {
+        for(int c = 0; c < nColumns; ++c) {
+            QVariant v = q.value(c);
+            bytes += valueBytes(v);
+            if(row % stride == 0)
+                widths[c] = qMin(COLUMN_SAMPLE_MAX_CHARS, qMax(widths[c], displayLength(v)));
+        }
+    }
+    return bytes;
+}
+
+static void sampleColumnWidths(const ResultRows& rows, int nColumns, QVector<int>& widths) {
+    widths.fill(0, nColumns);
+    int stride = qMax(1, rows.count() / COLUMN_SAMPLE_ROWS);
+    for(int row = 0; row < rows.count(); row += stride) {
+        for(int c = 0; c < nColumns && c < rows.at(row).count(); ++c)
+            widths[c] = qMin(COLUMN_SAMPLE_MAX_CHARS, qMax(widths[c], displayLength(rows.at(row).at(c))));
+    }
+}
+
+int DbConnection::queryTableContent(QSqlQuery* query, QVector<int>* columnWidths, const QAtomicInt* latest, int generation) {
+    TraceSpan span("queryTableContent", "db");
+    int nRows = SUPERSEDED;
+    if(superseded(latest, generation))
+        span.setArg("superseded", true);
+    else
+        nRows = execQuery(*query);
+    // the query can't be interrupted, but sampling can still be skipped
+    if(nRows == SUPERSEDED || superseded(latest, generation))
+        columnWidths->clear();
+    else if(query->isSelect())
+        queryStats.bytesFetched.fetchAndAddRelaxed(sampleColumnWidths(*query, nRows, *columnWidths));
+    else
+        columnWidths->clear();
+    return nRows;
 }
 
 QStringList DbConnection::columnNames(QString table) const {
@@ -124,16 +267,81 @@ QStringList DbConnection::columnNames(QString table) const {
         names << record.fieldName(i);
     return names;
 }
-void DbConnection::queryTableColumns(Schema* res, QString tableName, QObject* callbackOwner, const char* callbackName) {
-    driver->columns(*res, tableName);
-    QMetaObject::invokeMethod(callbackOwner, callbackName, Qt::QueuedConnection, Q_ARG(int, /*unused:*/0));
+Schema DbConnection::queryTableColumns(QString tableName) {
+    TraceSpan span("Driver::columns", "db");
+    span.setArg("table", tableName);
+    Schema columns;
+    driver->columns(columns, tableName);
+    return columns;
 }
 
-void DbConnection::queryTableUpdate(QString query, QObject *callbackOwner, const char *callbackName) {
+UpdateResult DbConnection::queryTableUpdate(QString query) {
     QSqlQuery q(*driver);
     q.prepare(query);
     int rowsAffected = execQuery(q);
-    QMetaObject::invokeMethod(callbackOwner, callbackName, Qt::QueuedConnection, Q_ARG(int, rowsAffected), Q_ARG(int, q.lastInsertId().toInt()));
+    return UpdateResult{rowsAffected, q.lastInsertId().toInt()};
+}
+
+ResultRows DbConnection::queryTableStream(QString query, QSqlQuery* cursor, int window, QVector<int>* columnWidths, QSqlRecord* record, const QAtomicInt* latest, int generation) {
+    TraceSpan span("queryTableStream", "db");
+    span.setArg("query", query.left(256));
+    ResultRows rows;
+    if(superseded(latest, generation)) {
+        span.setArg("superseded", true);
+        return rows;
+    }
+    QString name = cursorName(cursor);
+    QString msg;
+    QElapsedTimer timer;
+    timer.start();
+    queryStats.queries.ref();
+    bool opened = driver->openCursor(*cursor, query, name);
+    // as in execQuery, a select can be opened again once reconnected
+    if(!opened && driver->isConnectionLost(driver->cursorError(*cursor, name)) && Driver::isSelectStatement(query) && reopen())
+        opened = driver->openCursor(*cursor, query, name);
+    bool more = opened && driver->fetchCursor(*cursor, name, window, rows);
+    countFetched(rows);
+    QSqlError error = driver->cursorError(*cursor, name);
+    *record = driver->cursorRecord(*cursor, name);
+    if(error.isValid())
+        msg = "Error: " + error.text();
+    else if(!record->isEmpty())
+        msg = QString::number(rows.count()) + (more ? "+" : "") + " rows retrieved";
+    else
+        msg = QString::number(cursor->numRowsAffected()) + " rows affected";
+    if(error.isValid())
+        queryStats.errors.ref();
+    // the query panel's statements come this way
+    statementRan(!record->isEmpty());
+    queryStats.queryMicros.fetchAndAddRelaxed(timer.nsecsElapsed() / 1000);
+    sampleColumnWidths(rows, record->count(), *columnWidths);
+    emit queryExecuted(query, msg);
+    return rows;
+}
+
+ResultRows DbConnection::fetchTableStream(QSqlQuery* cursor, int window, const QAtomicInt* latest, int generation) {
+    TraceSpan span("fetchTableStream", "db");
+    ResultRows rows;
+    if(superseded(latest, generation)) {
+        span.setArg("superseded", true);
+        return rows;
+    }
+    QString name = cursorName(cursor);
+    driver->fetchCursor(*cursor, name, window, rows);
+    countFetched(rows);
+    span.setArg("rows", rows.count());
+    // the rest of the result can't be picked up again on a new connection,
+    // so at least don't let it pass for the end of the data
+    QSqlError error = driver->cursorError(*cursor, name);
+    if(error.isValid()) {
+        queryStats.errors.ref();
+        emit queryExecuted(QString(), "Error: results are incomplete, " + error.text());
+    }
+    return rows;
+}
+
+void DbConnection::closeTableStream(QString name) {
+    driver->closeCursor(name);
 }
 
 void DbConnection::populateDatabases() {
@@ -161,28 +369,58 @@ void DbConnection::deleteTable(QString tableName) {
 
 void DbConnection::start() {
     if(useSshTunnel) {
-        tunnel.thread = new QThread;
-        tunnel.ssh = new SshThread(sshParams);
-        tunnel.ssh->moveToThread(tunnel.thread);
-        connect(tunnel.thread, SIGNAL(started()), tunnel.ssh, SLOT(connectToServer()));
-        connect(tunnel.ssh, SIGNAL(sshTunnelOpened(QString,int)), this, SLOT(openDatabase(QString,int)));
-        connect(tunnel.ssh, SIGNAL(tunnelFailed(QString)), this, SIGNAL(connectionFailed(QString)));
-        connect(tunnel.ssh, SIGNAL(confirmUnknownHost(QString,bool*)), this, SIGNAL(confirmUnknownHost(QString,bool*)), Qt::BlockingQueuedConnection);
-        tunnel.thread->start();
+        // reuses a session to the same server if another tab has one
+        tunnel = SshSessionPool::instance().acquire(sshParams, tunnelStats);
+        connect(tunnel, SIGNAL(opened(QString,int)), this, SLOT(openDatabase(QString,int)));
+        connect(tunnel, SIGNAL(socketOpened(QString)), this, SLOT(openDatabaseSocket(QString)));
+        connect(tunnel, SIGNAL(failed(QString)), this, SIGNAL(connectionFailed(QString)));
+        connect(tunnel, SIGNAL(lost(QString)), this, SLOT(tunnelLost(QString)));
+        connect(tunnel, SIGNAL(restored()), this, SLOT(tunnelRestored()));
+        // passed straight on from the SSH thread, since this thread may be
+        // waiting for the session while the question is open
+        connect(tunnel, SIGNAL(confirmUnknownHost(QString)), this, SIGNAL(confirmUnknownHost(QString)), Qt::DirectConnection);
+        tunnel->open();
     } else {
         openDatabase(sqlParams.host, sqlParams.port);
     }
 }
 
+void DbConnection::answerUnknownHost(bool ok) {
+    if(tunnel)
+        tunnel->answerUnknownHost(ok);
+}
+
 QString DbConnection::databaseName() const {
     return driver->databaseName();
 }
 
 void DbConnection::openDatabase(QString host, int port) {
+    SJ_TRACE("openDatabase", "db");
+    // for trying out the application against a distant server, e.g.
+    // SJ_NETEM=rtt=200,rate=5mbit. Unix sockets and file databases have no
+    // TCP connection to put it on
+    QByteArray shapeSpec = qgetenv(LinkShape::ENV_VAR);
+    if(!shapeSpec.isEmpty() && socketDir.isEmpty() && !host.isEmpty()) {
+        bool ok;
+        LinkShape shape = LinkShape::parse(shapeSpec, &ok);
+        QString error = "invalid link shape " + shapeSpec;
+        delete linkProxy;
+        linkProxy = ok ? new LatencyProxy(host.toLocal8Bit(), port, shape) : nullptr;
+        if(!linkProxy || !linkProxy->listen(&error)) {
+            emit connectionFailed(QString(LinkShape::ENV_VAR) + ": " + error);
+            return;
+        }
+        emit queryExecuted(QString(), "Emulating a link of " + shape.toString() + " to " + host + ":" + QString::number(port));
+        host = "127.0.0.1";
+        port = linkProxy->port();
+    }
+
     QString name = "connection_" + QString::number(nConnections++);
     *((QSqlDatabase*) driver) = QSqlDatabase::addDatabase(sqlParams.driverName, name);
     driver->setHostName(host);
     driver->setPort(port);
+    if(!socketDir.isEmpty())
+        driver->setUnixSocket(socketDir, port);
     driver->setDatabaseName(sqlParams.dbName);
     driver->setUserName(sqlParams.user);
     driver->setPassword(sqlParams.pass);
@@ -196,6 +434,70 @@ void DbConnection::openDatabase(QString host, int port) {
     }
 }
 
+void DbConnection::openDatabaseSocket(QString dir) {
+    socketDir = dir;
+    openDatabase("localhost", sqlParams.port);
+}
+
+QVariant DbConnection::queryValue(QString query) {
+    QSqlQuery q(*driver);
+    q.setForwardOnly(true);
+    q.prepare(query);
+    execQuery(q);
+    QVariant value = q.next() ? q.value(0) : QVariant();
+    queryStats.bytesFetched.fetchAndAddRelaxed(valueBytes(value));
+    return value;
+}
+
+QByteArray DbConnection::queryValueChunk(QString query) {
+    QSqlQuery q(*driver);
+    q.setForwardOnly(true);
+    q.prepare(query);
+    // not via execQuery, a streamed save would flood the query log
+    if(!q.exec() || !q.next()) {
+        queryStats.errors.ref();
+        return QByteArray();
+    }
+    QByteArray data = q.value(0).toByteArray();
+    if(data.isNull())
+        data = QByteArray("");
+    queryStats.bytesFetched.fetchAndAddRelaxed(data.size());
+    return data;
+}
+
+void DbConnection::queryForeignRows(QString refTable, QStringList refColumns, QString condition, int previewLength) {
+    QStringList select;
+    QSqlRecord table = driver->record(refTable);
+    for(int i = 0; i < table.count(); ++i) {
+        QString name = table.fieldName(i);
+        QVariant::Type type = table.field(i).type();
+        bool isLong = type == QVariant::String || type == QVariant::ByteArray;
+        select << (isLong && !refColumns.contains(name) ?
+                       driver->prefixExpression(name, previewLength) + " AS \"" + name + "\"" :
+                       "\"" + name + "\"");
+    }
+    QSqlQuery q(*driver);
+    q.setForwardOnly(true);
+    q.prepare("SELECT " + (select.isEmpty() ? QString("*") : select.join(", ")) + " FROM \"" + refTable + "\" WHERE " + condition);
+    execQuery(q);
+    QSqlRecord record = q.record();
+    QStringList columns;
+    for(int i = 0; i < record.count(); ++i)
+        columns << record.fieldName(i);
+    QVector<int> keyColumns;
+    for(const QString& c : refColumns)
+        keyColumns << record.indexOf(c);
+    while(q.next()) {
+        ForeignRow row{columns, QVector<QVariant>(record.count())};
+        for(int i = 0; i < record.count(); ++i)
+            row.values[i] = q.value(i);
+        for(int i = 0; i < refColumns.count(); ++i) {
+            if(keyColumns.at(i) != -1)
+                foreignRows.insert(refTable, refColumns.at(i), row.values.at(keyColumns.at(i)), row);
+        }
+    }
+}
+
 void DbConnection::useDatabase(QString dbName) {
     QSqlQuery query(*driver);
     query.prepare("USE \"" + dbName + "\"");
@@ -205,6 +507,7 @@ void DbConnection::useDatabase(QString dbName) {
     emit databaseChanged(dbName);
 }
 
-void DbConnection::populateTables() {
+QStringList DbConnection::populateTables() {
     tableNames = driver->tableNames();
+    return tableNames;
 }
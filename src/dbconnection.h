@@ -15,8 +15,14 @@
 #include <QSqlDatabase>
 #include <functional>
 
+#include "tabledata.h"
+#include "foreignrowcache.h"
+#include "connectionstats.h"
+#include "jobqueue.h"
+
 class Driver;
-class SshThread;
+class SshTunnel;
+class LatencyProxy;
 class Schema;
 
 class QSqlDatabase;
@@ -44,6 +50,18 @@ struct SshParams {
     bool useSshKey;
     QByteArray sshPass;
     QByteArray sshKeyPath;
+    bool compress;
+    unsigned int windowSize;
+    unsigned int packetSize;
+    bool unixSocket;
+    int connectTimeout; // ms
+    // set from the driver when unixSocket is enabled
+    QByteArray socketName;
+};
+
+struct UpdateResult {
+    int rowsAffected;
+    int insertId;
 };
 
 class DbConnection : public QObject {
@@ -53,6 +71,20 @@ public:
     explicit DbConnection(const QSettings& settings);
     virtual ~DbConnection();
 
+    // types passed through queued signals to and from the worker thread.
+    // Call once before starting any connection
+    static void registerMetaTypes();
+
+    // returned by queryTableContent in place of a row count when a newer
+    // request made the query obsolete before it ran. The streamed queries
+    // return no rows instead
+    enum { SUPERSEDED = -1 };
+
+    // Work for the worker thread goes through here, so that what the user is
+    // waiting on can go ahead of background work. The query methods below
+    // are meant to be called from these jobs
+    JobQueue& jobs() { return *jobQueue; }
+
     virtual QSqlQueryModel* query(QString q, QSqlQueryModel* update = 0);
 
     QStringList databaseNames() const { return dbNames; }
@@ -63,28 +95,54 @@ public:
 
     QStringList columnNames(QString table) const;
 
-public slots:
+    // identifies a model's server-side cursor on this connection
+    static QString cursorName(const QSqlQuery* cursor);
+
+    // rows of referenced tables, shared by all models on this connection
+    ForeignRowCache& foreignRowCache() { return foreignRows; }
+
+    // live counters, safe to read from any thread. No tunnel stats without SSH
+    const QueryStats& queryStatistics() const { return queryStats; }
+    const TunnelStats* tunnelStatistics() const { return useSshTunnel ? &tunnelStats : nullptr; }
+    // both of the above as one JSON document, for attaching to bug reports
+    QJsonObject statsSnapshot() const;
+
     virtual int execQuery(QSqlQuery &q) const;
 
-    void queryTableColumns(Schema *res, QString tableName, QObject* callbackOwner, const char* callbackName = "selectComplete");
-    void queryTableMetadata(QString tableName, QObject* callbackOwner, const char *callbackName = "describeComplete");
-    void queryTableContent(QSqlQuery *query, QObject* callbackOwner, const char* callbackName = "selectComplete");
-    void queryTableUpdate(QString query, QObject* callbackOwner, const char* callbackName = "updateComplete");
+    Schema queryTableColumns(QString tableName);
+    TableMetadata queryTableMetadata(QString tableName);
+    // these skip the query if *latest has moved on from generation by the
+    // time the worker gets to it
+    int queryTableContent(QSqlQuery *query, QVector<int>* columnWidths, const QAtomicInt* latest = nullptr, int generation = 0);
+    virtual UpdateResult queryTableUpdate(QString query);
+    // record receives the result's columns
+    ResultRows queryTableStream(QString query, QSqlQuery* cursor, int window, QVector<int>* columnWidths, QSqlRecord* record, const QAtomicInt* latest = nullptr, int generation = 0);
+    ResultRows fetchTableStream(QSqlQuery* cursor, int window, const QAtomicInt* latest = nullptr, int generation = 0);
+    void closeTableStream(QString name);
+    QVariant queryValue(QString query);
+    // a null array if the query failed, an empty one past the end of the value
+    QByteArray queryValueChunk(QString query);
+    // adds the rows of refTable matching condition to foreignRowCache(), with
+    // text and binary values other than the keys cut to previewLength
+    void queryForeignRows(QString refTable, QStringList refColumns, QString condition, int previewLength);
     QString queryCreateTable(QString tableName);
     void deleteTable(QString tableName);
     void createTable(QString tableName);
-    void populateTables();
+    QStringList populateTables();
     void useDatabase(QString dbName);
 
     void start();
     void cleanup();
+    // may be called from any thread while the connection is alive
+    void answerUnknownHost(bool ok);
 
     Driver* sqlDriver() const { return driver; }
 
 signals:
     void connectionSuccess();
     void connectionFailed(QString reason);
-    void confirmUnknownHost(QString fingerprint, bool* ok);
+    // reply with answerUnknownHost
+    void confirmUnknownHost(QString fingerprint);
 
     void queryExecuted(QString query, QString result) const;
     void databaseChanged(QString);
@@ -93,26 +151,45 @@ protected:
 
 private slots:
     void openDatabase(QString host, int port);
+    void openDatabaseSocket(QString dir);
+    void tunnelLost(QString reason);
+    void tunnelRestored();
 
 private:
     void newConnection();
 
     void populateDatabases();
+    void countFetched(const ResultRows& rows) const;
+    // called by both execQuery and queryTableStream after each statement
+    void statementRan(bool isSelect) const;
+    bool reopen() const;
 
 
     static int nConnections;
     bool useSshTunnel;
+    // directory of the tunnel's Unix socket, if it listens on one
+    QString socketDir;
+
+    // how long a query waits for a dropped SSH tunnel to come back
+    enum { RECONNECT_TIMEOUT = 60000 };
+    // the tunnel session the driver connection was opened over
+    mutable int driverGeneration;
 
-    struct {
-        SshThread* ssh;
-        QThread* thread;
-    } tunnel;
+    // shared with other connections to the same SSH server, null without SSH
+    SshTunnel* tunnel;
+    // emulates a remote link in front of the server, see LinkShape::ENV_VAR
+    LatencyProxy* linkProxy;
+    JobQueue* jobQueue;
 
     Driver* driver;
     SqlParams sqlParams;
     SshParams sshParams;
     QStringList dbNames;
     QStringList tableNames;
+    // cleared by statementRan, which is const
+    mutable ForeignRowCache foreignRows;
+    mutable QueryStats queryStats;
+    TunnelStats tunnelStats;
 };
 
 #endif // _SEQUELJOE_DBCONNECTION_H_
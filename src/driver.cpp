@@ -8,8 +8,13 @@
 #include <QSqlRecord>
 #include <QSqlDriver>
 #include <QSqlField>
+#include <QSqlError>
 #include <QSet>
 
+#ifdef HAVE_MYSQLCLIENT
+#include <mysql.h>
+#endif
+
 class SqlDriverList : public QAbstractListModel {
 public:
     SqlDriverList(QObject* parent = 0) : QAbstractListModel(parent)
@@ -68,8 +73,77 @@ int Driver::countRows(QSqlQuery& q) const {
     return q.size(); 
 }
 
+bool Driver::openCursor(QSqlQuery& q, QString sql, QString name) {
+    closeCursor(name);
+    q.finish();
+    // a forward-only result is not cached by the Qt driver, so each call
+    // to next() steps the underlying statement (e.g. sqlite3_step)
+    q.setForwardOnly(true);
+    return q.exec(sql);
+}
+
+bool Driver::fetchCursor(QSqlQuery& q, QString name, int n, ResultRows& out) {
+    Q_UNUSED(name);
+    int nColumns = q.record().count();
+    for(int i = 0; i < n; ++i) {
+        if(!q.next())
+            return false;
+        QVector<QVariant> row(nColumns);
+        for(int c = 0; c < nColumns; ++c)
+            row[c] = q.value(c);
+        out.append(row);
+    }
+    return true;
+}
+
+QSqlRecord Driver::cursorRecord(QSqlQuery& q, QString name) const {
+    Q_UNUSED(name);
+    return q.record();
+}
+
+QSqlError Driver::cursorError(QSqlQuery& q, QString name) const {
+    Q_UNUSED(name);
+    return q.lastError();
+}
+
+bool Driver::isConnectionLost(const QSqlError& error) const {
+    return error.type() == QSqlError::ConnectionError || !isOpen();
+}
+
+bool Driver::isSelectStatement(const QString& sql) {
+    return QRegExp("^\\s*(select|with|values|table)\\b", Qt::CaseInsensitive).indexIn(sql) == 0;
+}
+
 class MySqlDriver : public Driver {
 public:
+    virtual QString prefixExpression(QString column, int length) const override {
+        return "LEFT(\"" + column + "\", " + QString::number(length) + ")";
+    }
+    virtual bool isConnectionLost(const QSqlError& error) const override {
+        // CR_SERVER_GONE_ERROR, CR_SERVER_LOST, CR_SERVER_LOST_EXTENDED
+        static const QStringList codes{"2006", "2013", "2055"};
+        return codes.contains(error.nativeErrorCode()) || Driver::isConnectionLost(error);
+    }
+    virtual QString unixSocketName(int) const override {
+        return "mysqld.sock";
+    }
+    virtual bool hashComments() const override {
+        return true;
+    }
+    virtual void setUnixSocket(QString dir, int) override {
+        // libmysqlclient only uses the socket when the host is localhost
+        setHostName("localhost");
+        setConnectOptions("UNIX_SOCKET=" + dir + "/mysqld.sock");
+    }
+
+    // LENGTH counts bytes
+    virtual QString lengthExpression(QString column) const override {
+        return "CHAR_LENGTH(\"" + column + "\")";
+    }
+    virtual QString substringExpression(QString column, qint64 from, int length) const override {
+        return "SUBSTRING(\"" + column + "\", " + QString::number(from + 1) + ", " + QString::number(length) + ")";
+    }
+
     virtual QStringList databases() override {
         QStringList dbnames;
         QSqlQuery q("show databases", *this);
@@ -165,6 +239,7 @@ public:
             do {
                 if(q.value(2).toBool())
                     metadata.primaryKeyColumn = i;
+                metadata.columnNames[i] = q.value(0).toString();
                 metadata.columnTypes[i] = q.value(7).toString();
                 metadata.columnComments[i] = q.value(1).toString();
                 metadata.foreignKeys[i] = {q.value(0).toString(), q.value(4).toString(), q.value(5).toString() };
@@ -186,6 +261,10 @@ public:
     }
 
     virtual bool open() override {
+#ifdef HAVE_MYSQLCLIENT
+        // a new session
+        sessionChanged = false;
+#endif
         QSqlQuery q(*this);
         return QSqlDatabase::open() && q.exec("SET SESSION sql_mode = 'ANSI_QUOTES'");
     }
@@ -194,6 +273,183 @@ public:
         return "CREATE TABLE \"" + table + "\" (\"id\" INT UNSIGNED PRIMARY KEY NOT NULL AUTO_INCREMENT)";
     }
 
+#ifdef HAVE_MYSQLCLIENT
+    // QMYSQL always buffers the whole result with mysql_store_result. Stream
+    // selects instead with mysql_use_result, on a connection of their own
+    // since an unbuffered result ties up its connection until fully read.
+    // That session doesn't share this one's transaction, temporary tables or
+    // variables, so only statements which can't depend on them are streamed
+    virtual bool openCursor(QSqlQuery& q, QString sql, QString name) override {
+        closeCursor(name);
+        sql = sql.trimmed();
+        if(sql.endsWith(';'))
+            sql.chop(1);
+        // locking and INTO must happen in this session, and @ may be a user
+        // variable set here
+        QRegExp local("@|\\b(into|procedure|for\\s+(update|share)|lock\\s+in\\s+share\\s+mode)\\b", Qt::CaseInsensitive);
+        if(sessionChanged || !isSelectStatement(sql) || local.indexIn(sql) != -1) {
+            // anything else might begin a transaction, create a temporary
+            // table, set a variable or change the database
+            if(!isSelectStatement(sql))
+                sessionChanged = true;
+            return Driver::openCursor(q, sql, name);
+        }
+        Stream* s = connectStream();
+        // e.g. the server refused another connection. Nothing has run yet
+        if(!s)
+            return Driver::openCursor(q, sql, name);
+        q.finish();
+        streams.insert(name, s);
+        QByteArray query = sql.toUtf8();
+        if(mysql_real_query(s->conn, query.constData(), query.length()) == 0)
+            s->result = mysql_use_result(s->conn);
+        if(!s->result) {
+            s->error = streamError(s->conn);
+            return false;
+        }
+        unsigned nFields = mysql_num_fields(s->result);
+        MYSQL_FIELD* fields = mysql_fetch_fields(s->result);
+        for(unsigned i = 0; i < nFields; ++i)
+            s->record.append(QSqlField(QString::fromUtf8(fields[i].name), fieldType(fields[i])));
+        return true;
+    }
+
+    virtual ~MySqlDriver() {
+        for(Stream* s : streams)
+            closeStream(s);
+    }
+
+    virtual bool fetchCursor(QSqlQuery& q, QString name, int n, ResultRows& out) override {
+        Stream* s = streams.value(name);
+        if(!s)
+            return Driver::fetchCursor(q, name, n, out);
+        if(!s->result || s->done)
+            return false;
+        unsigned nColumns = mysql_num_fields(s->result);
+        MYSQL_FIELD* fields = mysql_fetch_fields(s->result);
+        for(int i = 0; i < n; ++i) {
+            MYSQL_ROW r = mysql_fetch_row(s->result);
+            if(!r) {
+                s->done = true;
+                if(mysql_errno(s->conn))
+                    s->error = streamError(s->conn);
+                return false;
+            }
+            unsigned long* lengths = mysql_fetch_lengths(s->result);
+            QVector<QVariant> row(nColumns);
+            for(unsigned c = 0; c < nColumns; ++c)
+                row[c] = value(fields[c], r[c], lengths[c]);
+            out.append(row);
+        }
+        return true;
+    }
+
+    virtual QSqlRecord cursorRecord(QSqlQuery& q, QString name) const override {
+        Stream* s = streams.value(name);
+        return s ? s->record : q.record();
+    }
+
+    virtual QSqlError cursorError(QSqlQuery& q, QString name) const override {
+        Stream* s = streams.value(name);
+        return s ? s->error : q.lastError();
+    }
+
+    virtual void closeCursor(QString name) override {
+        if(Stream* s = streams.take(name))
+            closeStream(s);
+    }
+
+private:
+    struct Stream {
+        MYSQL* conn;
+        MYSQL_RES* result;
+        QSqlRecord record;
+        QSqlError error;
+        // read to the end, or failed
+        bool done;
+    };
+
+    Stream* connectStream() {
+        MYSQL* conn = mysql_init(nullptr);
+        if(!conn)
+            return nullptr;
+        QString socket;
+        for(QString option : connectOptions().split(';')) {
+            if(option.trimmed().startsWith("UNIX_SOCKET="))
+                socket = option.trimmed().mid(12);
+        }
+        QByteArray host = hostName().toUtf8(), user = userName().toUtf8(), pass = password().toUtf8();
+        QByteArray db = databaseName().toUtf8(), unixSocket = socket.toUtf8();
+        if(!mysql_real_connect(conn, host.constData(), user.constData(), pass.constData(), db.constData(),
+                               port() == -1 ? 0 : port(), unixSocket.isEmpty() ? nullptr : unixSocket.constData(), 0) ||
+                mysql_set_character_set(conn, "utf8mb4") != 0 ||
+                mysql_query(conn, "SET SESSION sql_mode = 'ANSI_QUOTES'") != 0) {
+            mysql_close(conn);
+            return nullptr;
+        }
+        return new Stream{conn, nullptr, QSqlRecord(), QSqlError(), false};
+    }
+
+    void closeStream(Stream* s) {
+        // freeing an unfinished result reads it to the end, so stop the
+        // server sending it first
+        if(s->result && !s->done) {
+            QSqlQuery kill(*this);
+            kill.exec("KILL QUERY " + QString::number(mysql_thread_id(s->conn)));
+        }
+        if(s->result)
+            mysql_free_result(s->result);
+        mysql_close(s->conn);
+        delete s;
+    }
+
+    static QSqlError streamError(MYSQL* conn) {
+        return QSqlError(QString::fromUtf8(mysql_error(conn)), QString(), QSqlError::StatementError, QString::number(mysql_errno(conn)));
+    }
+
+    static QVariant::Type fieldType(const MYSQL_FIELD& f) {
+        switch(f.type) {
+        case MYSQL_TYPE_TINY: case MYSQL_TYPE_SHORT: case MYSQL_TYPE_LONG:
+        case MYSQL_TYPE_INT24: case MYSQL_TYPE_LONGLONG: case MYSQL_TYPE_YEAR:
+            return (f.flags & UNSIGNED_FLAG) ? QVariant::ULongLong : QVariant::LongLong;
+        case MYSQL_TYPE_FLOAT: case MYSQL_TYPE_DOUBLE:
+            return QVariant::Double;
+        case MYSQL_TYPE_BIT:
+            return QVariant::ByteArray;
+        case MYSQL_TYPE_TINY_BLOB: case MYSQL_TYPE_MEDIUM_BLOB: case MYSQL_TYPE_LONG_BLOB:
+        case MYSQL_TYPE_BLOB: case MYSQL_TYPE_STRING: case MYSQL_TYPE_VAR_STRING:
+            // charset 63 is binary
+            return f.charsetnr == 63 ? QVariant::ByteArray : QVariant::String;
+        default:
+            // decimals, dates and times are shown as the server formats them
+            return QVariant::String;
+        }
+    }
+
+    // the text protocol sends every value as a string
+    static QVariant value(const MYSQL_FIELD& f, const char* data, unsigned long length) {
+        QVariant::Type type = fieldType(f);
+        if(!data)
+            return QVariant(type);
+        QByteArray bytes = QByteArray::fromRawData(data, length);
+        switch(type) {
+        case QVariant::LongLong:
+            return bytes.toLongLong();
+        case QVariant::ULongLong:
+            return bytes.toULongLong();
+        case QVariant::Double:
+            return bytes.toDouble();
+        case QVariant::ByteArray:
+            return QByteArray(data, length);
+        default:
+            return QString::fromUtf8(data, length);
+        }
+    }
+
+    QHash<QString, Stream*> streams;
+    // set once something run here may have left state a stream can't see
+    bool sessionChanged = false;
+#endif
 };
 
 class SqliteDriver : public Driver {
@@ -231,12 +487,17 @@ public:
         q.exec();
 
         int i = 0;
+        QStringList names, types;
         while(q.next()) {
             if(q.value(5).toBool())
                 metadata.primaryKeyColumn = i;
+            names << q.value(1).toString();
+            types << q.value(2).toString();
             i++;
         }
         metadata.resize(i);
+        metadata.columnNames = names.toVector();
+        metadata.columnTypes = types.toVector();
 
         return metadata;
     }
@@ -278,6 +539,21 @@ class SqlcipherDriver : public SqliteDriver
 
 class PostgresDriver : public Driver {
 public:
+    virtual bool isConnectionLost(const QSqlError& error) const override {
+        // QPSQL doesn't report a native code when libpq loses the connection
+        QString text = error.databaseText();
+        return text.contains("server closed the connection") || text.contains("no connection to the server") ||
+                text.contains("could not send data to server") || Driver::isConnectionLost(error);
+    }
+    // libpq takes a directory as the host and derives the file from the port
+    virtual QString unixSocketName(int port) const override {
+        return ".s.PGSQL." + QString::number(port);
+    }
+    virtual void setUnixSocket(QString dir, int port) override {
+        setHostName(dir);
+        setPort(port);
+    }
+
     virtual QStringList databases() override {
         QStringList dbnames;
         // todo fix
@@ -347,6 +623,7 @@ public:
             do {
                 if(q.value(2).toBool())
                     metadata.primaryKeyColumn = i;
+                metadata.columnNames[i] = q.value(0).toString();
                 metadata.columnTypes[i] = q.value(1).toString();
                 metadata.foreignKeys[i] = {q.value(0).toString(), q.value(3).toString(), q.value(4).toString() };
                 i++;
@@ -363,6 +640,49 @@ public:
     virtual QString createTableQuery(QString table) override {
         return "CREATE TABLE \"" + table + "\" (\"id\" SERIAL NOT NULL PRIMARY KEY)";
     }
+
+    // QPSQL has no streaming mode, so wrap queries in a server-side cursor. WITH HOLD
+    // lets the cursor outlive the implicit transaction, so we don't have to keep
+    // one open on a connection that is shared with the table views. The price
+    // is that the server materialises the whole result when that transaction
+    // commits, i.e. before DECLARE returns: memory on the client is bounded,
+    // but the first rows take as long as the whole query
+    virtual bool openCursor(QSqlQuery& q, QString sql, QString name) override {
+        closeCursor(name);
+        sql = sql.trimmed();
+        if(sql.endsWith(';'))
+            sql.chop(1);
+        if(isSelectStatement(sql)) {
+            q.finish();
+            q.setForwardOnly(true);
+            // fetching zero rows reports errors and the result record up front
+            if(q.exec("DECLARE \"" + name + "\" NO SCROLL CURSOR WITH HOLD FOR " + sql) &&
+                    q.exec("FETCH FORWARD 0 FROM \"" + name + "\"")) {
+                cursors.insert(name);
+                return true;
+            }
+        }
+        // not a query, or a script of several statements. Run it as it is
+        return Driver::openCursor(q, sql, name);
+    }
+
+    virtual bool fetchCursor(QSqlQuery& q, QString name, int n, ResultRows& out) override {
+        if(!cursors.contains(name))
+            return Driver::fetchCursor(q, name, n, out);
+        if(!q.exec("FETCH FORWARD " + QString::number(n) + " FROM \"" + name + "\""))
+            return false;
+        return Driver::fetchCursor(q, name, n, out);
+    }
+
+    virtual void closeCursor(QString name) override {
+        if(cursors.remove(name)) {
+            QSqlQuery q(*this);
+            q.exec("CLOSE \"" + name + "\"");
+        }
+    }
+
+private:
+    QSet<QString> cursors;
 };
 
 QAbstractListModel* Driver::driverListModel(QObject *parent) {
@@ -381,6 +701,18 @@ Driver* Driver::createDriver(QString type) {
     return nullptr;
 }
 
+QString Driver::prefixExpression(QString column, int length) const {
+    return substringExpression(column, 0, length);
+}
+
+QString Driver::substringExpression(QString column, qint64 from, int length) const {
+    return "substr(\"" + column + "\", " + QString::number(from + 1) + ", " + QString::number(length) + ")";
+}
+
+QString Driver::lengthExpression(QString column) const {
+    return "length(\"" + column + "\")";
+}
+
 QString Driver::quote(QVariant value) {
     QSqlField f;
     f.setType(value.type());
@@ -5,6 +5,8 @@
 #include "tabledata.h"
 
 class QSqlQuery;
+class QSqlError;
+class QSqlRecord;
 class QAbstractListModel;
 
 class Driver : public QSqlDatabase {
@@ -24,6 +26,39 @@ public:
     virtual QStringList tableNames() = 0;
     virtual QString createTableQuery(QString table) = 0;
     virtual int countRows(QSqlQuery& q) const;
+
+    // a prefix of a long text/blob column and its full length, so that a
+    // page of results doesn't have to carry every value in full
+    virtual QString prefixExpression(QString column, int length) const;
+    virtual QString lengthExpression(QString column) const;
+    // length bytes or characters of column starting at from (zero based)
+    virtual QString substringExpression(QString column, qint64 from, int length) const;
+
+    // server-side cursors, so that unbounded results can be pulled in windows
+    // instead of being materialised by the Qt driver. name identifies the cursor
+    // on this connection; opening a cursor under an existing name replaces it
+    virtual bool openCursor(QSqlQuery& q, QString sql, QString name);
+    // appends up to n rows to out. Returns false once the cursor is exhausted
+    virtual bool fetchCursor(QSqlQuery& q, QString name, int n, ResultRows& out);
+    // the columns of an open cursor, and why it failed to open or fetch.
+    // The cursor may be read without going through q
+    virtual QSqlRecord cursorRecord(QSqlQuery& q, QString name) const;
+    virtual QSqlError cursorError(QSqlQuery& q, QString name) const;
+    virtual void closeCursor(QString name) { Q_UNUSED(name); }
+
+    // whether error means the connection to the server has gone, e.g. after
+    // a network outage, rather than a problem with the query
+    virtual bool isConnectionLost(const QSqlError& error) const;
+
+    // file name of the Unix socket the client library expects for a server
+    // on port, or empty if this driver can't connect through one
+    virtual QString unixSocketName(int port) const { Q_UNUSED(port); return QString(); }
+    // points the connection at the socket unixSocketName(port) inside dir
+    virtual void setUnixSocket(QString dir, int port) { Q_UNUSED(dir); Q_UNUSED(port); }
+    // whether # starts a comment to the end of the line
+    virtual bool hashComments() const { return false; }
+    // statements that only read, and so are safe to run again
+    static bool isSelectStatement(const QString& sql);
 };
 
 #endif // SQLDRIVER_H
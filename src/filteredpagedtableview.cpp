@@ -10,7 +10,7 @@
 #include "tableview.h"
 #include "roles.h"
 #include "sqlmodel.h" // for RefreshEvent
-#include "tablecell.h"
+#include "recordview.h"
 
 #include <QVBoxLayout>
 #include <QPushButton>
@@ -21,58 +21,12 @@
 #include <QComboBox>
 #include <QLineEdit>
 #include <QToolButton>
-#include <QAbstractProxyModel>
-#include <QIdentityProxyModel>
 #include <QMenu>
 #include <QInputDialog>
 
-class PivotProxy : public QAbstractProxyModel {
-public:
-    PivotProxy(QObject *parent = 0) : QAbstractProxyModel(parent)
-    {
-    }
-    QModelIndex mapFromSource(const QModelIndex& sourceIndex) const override {
-        return sourceModel() ? index(sourceIndex.column(), sourceIndex.row()+1) : QModelIndex();
-    }
-    QModelIndex mapToSource(const QModelIndex& proxyIndex) const override {
-        return (sourceModel() && proxyIndex.column()>0) ? sourceModel()->index(proxyIndex.column()-1, proxyIndex.row()) : QModelIndex();
-    }
-    QModelIndex index(int row, int col, const QModelIndex& parent = QModelIndex()) const override {
-        return createIndex(row, col);
-    }
-    QModelIndex parent(const QModelIndex& sourceIndex) const override {
-        return QModelIndex();
-    }
-    int rowCount(const QModelIndex&) const override {
-        return sourceModel() ? sourceModel()->columnCount() : 0;
-    }
-    QVariant headerData(int section, Qt::Orientation orientation, int role) const {
-        return QVariant();
-    }
-    bool hasChildren(const QModelIndex &parent) const override {
-        if(!parent.isValid()) return true;
-        return false;
-    }
-    int columnCount(const QModelIndex&) const override {
-        return sourceModel() ? sourceModel()->rowCount() + 1 : 0;
-    }
-    QVariant data(const QModelIndex& idx, int role) const override {
-        if(sourceModel() && idx.column() == 0) {
-            return sourceModel()->headerData(idx.row(), Qt::Horizontal, role);
-        } else
-            return QAbstractProxyModel::data(idx, role);
-    }
-    bool setData(const QModelIndex &index, const QVariant &value, int role) override {
-        if(index.column() == 0) return false;
-        if(sourceModel()) return sourceModel()->setData(mapToSource(index),value,role);
-        return false;
-    }
-};
-
 FilteredPagedTableView::FilteredPagedTableView(QWidget *parent) :
     QWidget(parent),
-    isPivot(false),
-    pivotModel(new PivotProxy(this)),
+    isRecordView(false),
     rowsPerPage(100)
 {
     QBoxLayout* layout = new QVBoxLayout(this);
@@ -80,6 +34,9 @@ FilteredPagedTableView::FilteredPagedTableView(QWidget *parent) :
 
     table = new TableView(this);
     layout->addWidget(table);
+    recordView = new RecordView(this);
+    recordView->hide();
+    layout->addWidget(recordView);
 
     { // widget containing a toolbar with filter and pagination options
         QHBoxLayout* bar = new QHBoxLayout();
@@ -97,7 +54,7 @@ FilteredPagedTableView::FilteredPagedTableView(QWidget *parent) :
         pageNum = new QLabel(this);
 
         QMenu* viewMenu = new QMenu(this);
-        viewMenu->addAction("Pivot", this, SLOT(setPivotView(bool)))->setCheckable(true);
+        viewMenu->addAction("Record View", this, SLOT(setRecordView(bool)))->setCheckable(true);
         viewMenu->addAction("Set rows per page", this, SLOT(setRowsPerPage()));
         view = new QPushButton("View");
         qobject_cast<QPushButton*>(view)->setMenu(viewMenu);
@@ -143,22 +100,16 @@ QStringList FilteredPagedTableView::filterOperations() const {
     return ops;
 }
 
-void FilteredPagedTableView::setPivotView(bool v) {
-    if(v == isPivot)
+void FilteredPagedTableView::setRecordView(bool v) {
+    if(v == isRecordView)
         return;
 
-    if(v) {
-        pivotModel->setSourceModel(model());
-        qobject_cast<TableCell*>(table->itemDelegate())->setFirstColumnIsHeader(true);
-        table->setModel(pivotModel);
-        table->setWordWrap(true);
-    } else {
-        table->setHeaderHidden(false);
-        qobject_cast<TableCell*>(table->itemDelegate())->setFirstColumnIsHeader(false);
-        table->setModel(pivotModel->sourceModel());
-    }
-
-    isPivot = v;
+    // show the record the grid's cursor is on
+    if(v && table->currentIndex().isValid())
+        recordView->setCurrentRecord(table->currentIndex().row());
+    table->setVisible(!v);
+    recordView->setVisible(v);
+    isRecordView = v;
 }
 
 void FilteredPagedTableView::setRowsPerPage() {
@@ -186,23 +137,8 @@ void FilteredPagedTableView::setModel(QAbstractItemModel *m) {
     filterColumns->clear();
     filterText->clear();
 
-    if(isPivot) {
-        pivotModel->setSourceModel(m);
-        // SOMETHING IS WRONG HERE:
-        // This nasty construct below is used get all the signal/slot goodness
-        // in TableView::setModel, but then using the pivotModel as the actual
-        // data. Moreover it bypasses the early return in that function that
-        // would prevent simply using pivotModel->setSourceModel.
-        // PROBLEM is, if you switch to a table for which there is no pre-existing
-        // model WHILE isPivot is true, TableView::sizeHintForColumn always returns
-        // -1, and the columns are not resized correctly. Even if there is an
-        // existing model, it seems that incorrect values are returned. The
-        // columns look OK but are not correct (until you click Reset)
-        table->setModel(m);
-        table->QTreeView::setModel(pivotModel);
-    } else {
-        table->setModel(m);
-    }
+    table->setModel(m);
+    recordView->setModel(m);
 
     if(m) {
         connect(m, SIGNAL(pagesChanged(int,int,int)), this, SLOT(updatePagination(int,int,int)));
@@ -222,7 +158,7 @@ void FilteredPagedTableView::setModel(QAbstractItemModel *m) {
 }
 
 QAbstractItemModel* FilteredPagedTableView::model() const {
-    return isPivot ? pivotModel->sourceModel() : table->model();
+    return table->model();
 }
 
 void FilteredPagedTableView::updatePagination(int firstRow, int rowsInPage, int totalRecords) {
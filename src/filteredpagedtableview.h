@@ -12,7 +12,7 @@
 #include <QAbstractItemModel>
 
 class TableView;
-class QAbstractProxyModel;
+class RecordView;
 
 class QAbstractButton;
 class QLabel;
@@ -35,15 +35,15 @@ private slots:
     void clearFilter();
     void runFilter();
     void refreshModel();
-    void setPivotView(bool);
+    void setRecordView(bool);
     void setRowsPerPage();
 
 private:
     QStringList filterOperations() const;
 
     TableView* table;
-    bool isPivot;
-    QAbstractProxyModel* pivotModel;
+    RecordView* recordView;
+    bool isRecordView;
     QComboBox* filterColumns;
     QComboBox* filterOperation;
     QLineEdit* filterText;
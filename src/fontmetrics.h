@@ -0,0 +1,24 @@
+/*
+ * Copyright 2014 Oliver Giles
+ *
+ * This file is part of SequelJoe. SequelJoe is licensed under the
+ * GNU GPL version 3. See LICENSE or <http://www.gnu.org/licenses/>
+ * for more information
+ */
+#ifndef _SEQUELJOE_FONTMETRICS_H_
+#define _SEQUELJOE_FONTMETRICS_H_
+
+#include <QFontMetrics>
+#include <QString>
+
+// QFontMetrics::width is deprecated from Qt 5.11 in favour of
+// horizontalAdvance, which older versions don't have
+inline int horizontalAdvance(const QFontMetrics& fm, const QString& text) {
+#if QT_VERSION >= QT_VERSION_CHECK(5, 11, 0)
+    return fm.horizontalAdvance(text);
+#else
+    return fm.width(text);
+#endif
+}
+
+#endif // _SEQUELJOE_FONTMETRICS_H_
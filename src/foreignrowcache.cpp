@@ -0,0 +1,35 @@
+/*
+ * Copyright 2014 Oliver Giles
+ *
+ * This file is part of SequelJoe. SequelJoe is licensed under the
+ * GNU GPL version 3. See LICENSE or <http://www.gnu.org/licenses/>
+ * for more information
+ */
+#include "foreignrowcache.h"
+
+#include <QMutexLocker>
+
+QString ForeignRowCache::key(const QString& table, const QString& column, const QVariant& value) {
+    return table + QChar(0x1f) + column + QChar(0x1f) + value.toString();
+}
+
+bool ForeignRowCache::contains(QString table, QString column, QVariant value) const {
+    QMutexLocker locker(&lock);
+    return rows.contains(key(table, column, value));
+}
+
+ForeignRow ForeignRowCache::row(QString table, QString column, QVariant value) const {
+    QMutexLocker locker(&lock);
+    ForeignRow* r = rows.object(key(table, column, value));
+    return r ? *r : ForeignRow{};
+}
+
+void ForeignRowCache::insert(QString table, QString column, QVariant value, const ForeignRow& row) {
+    QMutexLocker locker(&lock);
+    rows.insert(key(table, column, value), new ForeignRow(row));
+}
+
+void ForeignRowCache::clear() {
+    QMutexLocker locker(&lock);
+    rows.clear();
+}
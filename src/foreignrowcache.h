@@ -0,0 +1,44 @@
+/*
+ * Copyright 2014 Oliver Giles
+ *
+ * This file is part of SequelJoe. SequelJoe is licensed under the
+ * GNU GPL version 3. See LICENSE or <http://www.gnu.org/licenses/>
+ * for more information
+ */
+#ifndef _SEQUELJOE_FOREIGNROWCACHE_H_
+#define _SEQUELJOE_FOREIGNROWCACHE_H_
+
+#include <QCache>
+#include <QMutex>
+#include <QStringList>
+#include <QVariant>
+#include <QVector>
+
+struct ForeignRow {
+    QStringList columns;
+    QVector<QVariant> values;
+    bool isNull() const { return columns.isEmpty(); }
+};
+
+// Rows of referenced tables, keyed by the referenced column and its value.
+// Filled on the worker thread when a page of a table with foreign keys is
+// loaded, and read from the GUI thread to preview and expand foreign keys.
+// Least recently used rows are dropped once the cache is full.
+class ForeignRowCache {
+public:
+    explicit ForeignRowCache(int maxRows = 4096) : rows(maxRows) {}
+
+    bool contains(QString table, QString column, QVariant value) const;
+    ForeignRow row(QString table, QString column, QVariant value) const;
+    void insert(QString table, QString column, QVariant value, const ForeignRow& row);
+    void clear();
+
+private:
+    static QString key(const QString& table, const QString& column, const QVariant& value);
+
+    mutable QMutex lock;
+    // QCache::object updates the recency order, so even lookups are writes
+    mutable QCache<QString, ForeignRow> rows;
+};
+
+#endif // _SEQUELJOE_FOREIGNROWCACHE_H_
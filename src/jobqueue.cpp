@@ -0,0 +1,53 @@
+/*
+ * Copyright 2014 Oliver Giles
+ *
+ * This file is part of SequelJoe. SequelJoe is licensed under the
+ * GNU GPL version 3. See LICENSE or <http://www.gnu.org/licenses/>
+ * for more information
+ */
+#include "jobqueue.h"
+
+JobQueue::JobQueue(QObject* parent) :
+    QObject(parent),
+    scheduled(false)
+{
+}
+
+void JobQueue::enqueue(Job job) {
+    Trace::flowBegin(job.name, job.id);
+    QMutexLocker locker(&lock);
+    queues[job.priority].enqueue(job);
+    if(!scheduled) {
+        scheduled = true;
+        QMetaObject::invokeMethod(this, "runNext", Qt::QueuedConnection);
+    }
+}
+
+void JobQueue::clear() {
+    QMutexLocker locker(&lock);
+    for(QQueue<Job>& q : queues)
+        q.clear();
+}
+
+void JobQueue::runNext() {
+    Job job;
+    {
+        QMutexLocker locker(&lock);
+        int p = 0;
+        while(p < NUM_PRIORITIES && queues[p].isEmpty())
+            ++p;
+        if(p == NUM_PRIORITIES) {
+            scheduled = false;
+            return;
+        }
+        job = queues[p].dequeue();
+    }
+    TraceSpan span(job.name, "job");
+    span.setArg("priority", int(job.priority));
+    Trace::flowEnd(job.name, job.id);
+    job.work();
+    span.end();
+    // one job per event, so that the thread's other events, e.g. from the
+    // SSH tunnel, never wait behind a long queue
+    QMetaObject::invokeMethod(this, "runNext", Qt::QueuedConnection);
+}
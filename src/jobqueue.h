@@ -0,0 +1,146 @@
+/*
+ * Copyright 2014 Oliver Giles
+ *
+ * This file is part of SequelJoe. SequelJoe is licensed under the
+ * GNU GPL version 3. See LICENSE or <http://www.gnu.org/licenses/>
+ * for more information
+ */
+#ifndef _SEQUELJOE_JOBQUEUE_H_
+#define _SEQUELJOE_JOBQUEUE_H_
+
+#include <QCoreApplication>
+#include <QMutex>
+#include <QObject>
+#include <QPointer>
+#include <QQueue>
+#include <QSharedPointer>
+#include <QTimer>
+#include <functional>
+
+#include "trace.h"
+
+// Holds a job's result, if it has one, for its continuation
+template<typename T>
+struct JobResult {
+    typedef std::function<void(T)> Continuation;
+    T value;
+    template<typename F> void run(F& work) { value = work(); }
+    void pass(const Continuation& fn) const { fn(value); }
+};
+
+template<>
+struct JobResult<void> {
+    typedef std::function<void()> Continuation;
+    template<typename F> void run(F& work) { work(); }
+    void pass(const Continuation& fn) const { fn(); }
+};
+
+// The eventual result of a job submitted to a JobQueue
+template<typename T>
+class Future {
+public:
+    // fn is called with the result on the GUI thread once the job has run,
+    // unless context has been deleted by then. Call from the GUI thread, at
+    // most once. A job dropped by JobQueue::clear never calls it
+    void then(QObject* context, typename JobResult<T>::Continuation fn);
+
+private:
+    friend class JobQueue;
+
+    struct State {
+        explicit State(const char* name) : name(name), done(false) {}
+        const char* name;
+        QMutex lock;
+        bool done;
+        JobResult<T> result;
+        QPointer<QObject> context;
+        typename JobResult<T>::Continuation continuation;
+    };
+
+    explicit Future(QSharedPointer<State> state) : state(state) {}
+    // call with the lock held, once the job has run and then() was called
+    static void deliver(QSharedPointer<State> s);
+
+    QSharedPointer<State> state;
+};
+
+// Runs work on the thread it lives in, most urgent first. Jobs of the same
+// priority run in the order they were posted. A job that has started runs
+// to the end, so long ones should check whether they are still wanted
+class JobQueue : public QObject {
+    Q_OBJECT
+public:
+    enum Priority {
+        INTERACTIVE,  // something the user did and is waiting on
+        VISIBLE_PAGE, // what the user is looking at
+        PREFETCH,     // what they will probably look at next
+        BACKGROUND,   // metadata and housekeeping nobody is waiting on
+        NUM_PRIORITIES
+    };
+
+    explicit JobQueue(QObject* parent = 0);
+
+    // these may be called from any thread. name labels the job in traces
+    // and must outlive it, e.g. a string literal
+    template<typename F>
+    auto submit(Priority priority, const char* name, F work) -> Future<decltype(work())>;
+    void post(Priority priority, const char* name, std::function<void()> work) { submit(priority, name, work); }
+
+    // drops the jobs that haven't started
+    void clear();
+
+private slots:
+    void runNext();
+
+private:
+    struct Job {
+        Priority priority;
+        const char* name;
+        const void* id;
+        std::function<void()> work;
+    };
+    void enqueue(Job job);
+
+    QMutex lock;
+    QQueue<Job> queues[NUM_PRIORITIES];
+    // whether a call to runNext is on its way
+    bool scheduled;
+};
+
+template<typename T>
+void Future<T>::then(QObject* context, typename JobResult<T>::Continuation fn) {
+    QMutexLocker locker(&state->lock);
+    state->context = context;
+    state->continuation = fn;
+    if(state->done)
+        deliver(state);
+}
+
+template<typename T>
+void Future<T>::deliver(QSharedPointer<State> s) {
+    Trace::flowBegin(s->name, s.data());
+    QTimer::singleShot(0, QCoreApplication::instance(), [s]{
+        TraceSpan span(s->name, "then");
+        Trace::flowEnd(s->name, s.data());
+        if(s->context)
+            s->result.pass(s->continuation);
+        else
+            span.discard();
+    });
+}
+
+template<typename F>
+auto JobQueue::submit(Priority priority, const char* name, F work) -> Future<decltype(work())> {
+    typedef decltype(work()) T;
+    QSharedPointer<typename Future<T>::State> s(new typename Future<T>::State(name));
+    enqueue(Job{priority, name, s.data(), [s, work]() mutable {
+        s->result.run(work);
+        QMutexLocker locker(&s->lock);
+        s->done = true;
+        if(s->continuation)
+            Future<T>::deliver(s);
+    }});
+    return Future<T>(s);
+}
+
+#endif // _SEQUELJOE_JOBQUEUE_H_
@@ -0,0 +1,281 @@
+/*
+ * Copyright 2014 Oliver Giles
+ *
+ * This file is part of SequelJoe. SequelJoe is licensed under the
+ * GNU GPL version 3. See LICENSE or <http://www.gnu.org/licenses/>
+ * for more information
+ */
+#ifdef _WIN32
+#include <winsock2.h>
+#include <windows.h>
+#include <ws2tcpip.h>
+#define poll WSAPoll
+#define SHUT_WR SD_SEND
+typedef int socklen_t;
+#else
+#include <sys/socket.h>
+#include <poll.h>
+#include <netinet/in.h>
+#include <arpa/inet.h>
+#endif
+
+#include <errno.h>
+#include <string.h>
+
+#include <QRegExp>
+#include <QStringList>
+#include <QVector>
+
+#include "latencyproxy.h"
+#include "netutil.h"
+#include "savedconfig.h"
+
+LinkShape LinkShape::parse(QString spec, bool* ok) {
+    LinkShape shape;
+    *ok = true;
+#if QT_VERSION >= QT_VERSION_CHECK(5, 14, 0)
+    QStringList items = spec.split(',', Qt::SkipEmptyParts);
+#else
+    QStringList items = spec.split(',', QString::SkipEmptyParts);
+#endif
+    for(const QString& item : items) {
+        QString key = item.section('=', 0, 0).trimmed().toLower();
+        QString value = item.section('=', 1).trimmed().toLower();
+        bool valid;
+        if(key == "rate") {
+            qint64 scale = 1;
+            if(value.endsWith("kbit"))
+                scale = 1000;
+            else if(value.endsWith("mbit"))
+                scale = 1000000;
+            else if(value.endsWith("gbit"))
+                scale = 1000000000;
+            value.remove(QRegExp("[a-z]+$"));
+            shape.bitsPerSec = qint64(value.toDouble(&valid) * scale);
+        } else {
+            value.remove(QRegExp("ms$"));
+            int n = value.toInt(&valid);
+            if(key == "rtt")
+                shape.rttMs = n;
+            else if(key == "jitter")
+                shape.jitterMs = n;
+            else if(key == "packet")
+                shape.packetBytes = n;
+            else
+                valid = false;
+        }
+        if(!valid)
+            *ok = false;
+    }
+    if(shape.packetBytes <= 0 || shape.rttMs < 0 || shape.jitterMs < 0 || shape.bitsPerSec < 0)
+        *ok = false;
+    return shape;
+}
+
+QString LinkShape::toString() const {
+    QStringList items;
+    items << "rtt=" + QString::number(rttMs) << "jitter=" + QString::number(jitterMs);
+    if(bitsPerSec > 0)
+        items << "rate=" + QString::number(bitsPerSec);
+    items << "packet=" + QString::number(packetBytes);
+    return items.join(",");
+}
+
+LatencyProxy::LatencyProxy(QByteArray host, int port, LinkShape shape) :
+    host(host),
+    remotePort(port),
+    shape(shape),
+    sockListen(-1),
+    localPort(0),
+    stopping(0)
+{
+    wakeFds[0] = wakeFds[1] = -1;
+}
+
+LatencyProxy::~LatencyProxy() {
+    stop();
+    wait();
+    for(Link* l : links) {
+        closeSocket(l->up.from);
+        closeSocket(l->up.to);
+        delete l;
+    }
+    closeSocket(sockListen);
+    closeSocket(wakeFds[0]);
+    closeSocket(wakeFds[1]);
+}
+
+bool LatencyProxy::listen(QString* error) {
+    struct sockaddr_in sin = {0};
+    sin.sin_family = AF_INET;
+    sin.sin_port = 0;
+    sin.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    socklen_t sinlen = sizeof(sin);
+
+    sockListen = socket(PF_INET, SOCK_STREAM, IPPROTO_TCP);
+    if(sockListen < 0 || bind(sockListen, (struct sockaddr *)&sin, sinlen) < 0 ||
+            getsockname(sockListen, (struct sockaddr *)&sin, &sinlen) < 0 ||
+            ::listen(sockListen, 16) < 0 || !setNonBlocking(sockListen) ||
+            !socketPair(wakeFds) || !setNonBlocking(wakeFds[0])) {
+        *error = strerror(errno);
+        return false;
+    }
+    localPort = ntohs(sin.sin_port);
+    clock.start();
+    start();
+    return true;
+}
+
+void LatencyProxy::stop() {
+    stopping = 1;
+    if(wakeFds[1] != -1)
+        send(wakeFds[1], "", 1, 0);
+}
+
+qint64 LatencyProxy::oneWayDelay() {
+    qint64 ns = shape.rttMs * 1000000LL / 2;
+    if(shape.jitterMs > 0) {
+        std::uniform_int_distribution<qint64> jitter(-shape.jitterMs * 500000LL, shape.jitterMs * 500000LL);
+        ns += jitter(random);
+    }
+    return qMax(0LL, ns);
+}
+
+void LatencyProxy::schedule(Direction& d, QByteArray data, qint64 now) {
+    // without a rate limit, each read goes out as it came in
+    int unit = shape.bitsPerSec > 0 ? shape.packetBytes : data.size();
+    for(int i = 0; i < data.size(); i += unit) {
+        Packet p;
+        p.data = data.mid(i, unit);
+        qint64 serialise = shape.bitsPerSec > 0 ? p.data.size() * 8LL * 1000000000LL / shape.bitsPerSec : 0;
+        d.nextDeparture = qMax(now, d.nextDeparture) + serialise;
+        // jitter must not reorder a byte stream
+        p.due = qMax(d.nextDeparture + oneWayDelay(), d.lastArrival);
+        d.lastArrival = p.due;
+        d.queued += p.data.size();
+        d.queue.append(p);
+    }
+}
+
+bool LatencyProxy::receive(Direction& d, qint64 now) {
+    QByteArray buf(READ_SIZE, Qt::Uninitialized);
+    int n = recv(d.from, buf.data(), buf.size(), 0);
+    if(n == 0) {
+        d.eof = true;
+        return true;
+    }
+    if(n < 0)
+        return wouldBlock();
+    buf.truncate(n);
+    schedule(d, buf, now);
+    return true;
+}
+
+bool LatencyProxy::transmit(Direction& d, qint64 now) {
+    while(!d.queue.isEmpty() && d.queue.first().due <= now) {
+        Packet& p = d.queue.first();
+        int n = send(d.to, p.data.constData(), p.data.size(), 0);
+        if(n < 0)
+            return wouldBlock();
+        d.queued -= n;
+        if(n < p.data.size()) {
+            p.data.remove(0, n);
+            return true;
+        }
+        d.queue.removeFirst();
+    }
+    // pass on the end of the stream once everything before it has arrived
+    if(d.eof && d.queue.isEmpty() && !d.shut) {
+        shutdown(d.to, SHUT_WR);
+        d.shut = true;
+    }
+    return true;
+}
+
+void LatencyProxy::accept() {
+    int client = ::accept(sockListen, nullptr, nullptr);
+    if(client < 0)
+        return;
+    QString error;
+    int server = connectTcp(host.constData(), QByteArray::number(remotePort).constData(),
+                            SavedConfig::DEFAULT_SSH_CONNECT_TIMEOUT, &error, &stopping, wakeFds[0]);
+    if(server < 0) {
+        qWarning("Latency proxy could not connect to %s:%d: %s", host.constData(), remotePort, qPrintable(error));
+        closeSocket(client);
+        return;
+    }
+    setNonBlocking(client);
+    setNonBlocking(server);
+    Link* l = new Link;
+    l->up = Direction{client, server, {}, 0, 0, 0, false, false};
+    l->down = Direction{server, client, {}, 0, 0, 0, false, false};
+    links.append(l);
+}
+
+void LatencyProxy::run() {
+    QVector<struct pollfd> fds;
+    while(!stopping.load()) {
+        qint64 now = clock.nsecsElapsed();
+        qint64 nextDue = -1;
+        fds.clear();
+        fds.append({wakeFds[0], POLLIN, 0});
+        fds.append({sockListen, POLLIN, 0});
+        // two entries per link, for the client and the server socket
+        for(Link* l : links) {
+            short events[2] = {0, 0};
+            const Direction* dirs[2] = {&l->up, &l->down};
+            for(int i = 0; i < 2; ++i) {
+                const Direction& d = *dirs[i];
+                if(!d.eof && d.queued < MAX_QUEUED)
+                    events[i] |= POLLIN;
+                if(!d.queue.isEmpty()) {
+                    qint64 due = d.queue.first().due;
+                    if(due <= now)
+                        events[1 - i] |= POLLOUT;
+                    else if(nextDue == -1 || due < nextDue)
+                        nextDue = due;
+                }
+            }
+            // a hung up socket would otherwise wake poll() until the link is
+            // closed, even when there's nothing to do on it
+            fds.append({events[0] ? l->up.from : -1, events[0], 0});
+            fds.append({events[1] ? l->up.to : -1, events[1], 0});
+        }
+
+        int timeout = nextDue == -1 ? -1 : int((nextDue - now + 999999) / 1000000);
+        if(poll(fds.data(), fds.count(), timeout) < 0 && !wouldBlock())
+            break;
+
+        if(fds[0].revents & POLLIN) {
+            char buf[16];
+            while(recv(wakeFds[0], buf, sizeof(buf), 0) > 0)
+                ;
+        }
+        if(fds[1].revents & POLLIN)
+            accept();
+
+        now = clock.nsecsElapsed();
+        for(int i = 0, j = 2; i < links.count(); ++i, j += 2) {
+            Link* l = links.at(i);
+            if(j >= fds.count())
+                break; // accepted during this pass
+            bool ok = true;
+            if(fds[j].revents & (POLLIN | POLLHUP))
+                ok = receive(l->up, now);
+            if(ok && fds[j+1].revents & (POLLIN | POLLHUP))
+                ok = receive(l->down, now);
+            ok = ok && !(fds[j].revents & POLLERR) && !(fds[j+1].revents & POLLERR);
+            ok = ok && transmit(l->up, now) && transmit(l->down, now);
+            if(!ok || (l->up.shut && l->down.shut)) {
+                closeSocket(l->up.from);
+                closeSocket(l->up.to);
+                delete l;
+                links.removeAt(i);
+                // the remaining entries in fds now belong one link earlier
+                fds.remove(j, 2);
+                --i;
+                j -= 2;
+            }
+        }
+    }
+}
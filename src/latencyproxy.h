@@ -0,0 +1,104 @@
+/*
+ * Copyright 2014 Oliver Giles
+ *
+ * This file is part of SequelJoe. SequelJoe is licensed under the
+ * GNU GPL version 3. See LICENSE or <http://www.gnu.org/licenses/>
+ * for more information
+ */
+#ifndef _SEQUELJOE_LATENCYPROXY_H_
+#define _SEQUELJOE_LATENCYPROXY_H_
+
+#include <QAtomicInt>
+#include <QByteArray>
+#include <QElapsedTimer>
+#include <QList>
+#include <QString>
+#include <QThread>
+#include <random>
+
+// Characteristics of an emulated network link
+struct LinkShape {
+    int rttMs;
+    int jitterMs;      // the round trip varies by up to this much either way
+    qint64 bitsPerSec; // in each direction, 0 for no limit
+    int packetBytes;   // data is paced out in units of this size
+
+    LinkShape() : rttMs(0), jitterMs(0), bitsPerSec(0), packetBytes(DEFAULT_PACKET_BYTES) {}
+    bool isNull() const { return rttMs == 0 && jitterMs == 0 && bitsPerSec == 0; }
+
+    // e.g. "rtt=200,jitter=20,rate=5mbit,packet=1400". Times are in ms, rates
+    // in bit/s with an optional kbit, mbit or gbit suffix
+    static LinkShape parse(QString spec, bool* ok);
+    QString toString() const;
+
+    // the environment variable DbConnection reads a shape from
+    static constexpr const char* ENV_VAR = "SJ_NETEM";
+
+    enum { DEFAULT_PACKET_BYTES = 1400 };
+};
+
+// A TCP proxy on a loopback port that forwards each connection to host:port
+// as if over a slower, more distant link. Data read from either side is
+// paced out at the link's rate and released after half a round trip, so a
+// local server can be used to see which code paths are bound by round
+// trips or bandwidth
+class LatencyProxy : public QThread {
+public:
+    LatencyProxy(QByteArray host, int port, LinkShape shape);
+    virtual ~LatencyProxy();
+
+    // binds the local port and starts forwarding
+    bool listen(QString* error);
+    int port() const { return localPort; }
+
+    // may be called from any thread
+    void stop();
+
+protected:
+    void run() override;
+
+private:
+    struct Packet {
+        qint64 due; // ns on clock
+        QByteArray data;
+    };
+    // one way through a proxied connection
+    struct Direction {
+        int from;
+        int to;
+        QList<Packet> queue;
+        qint64 queued;
+        qint64 nextDeparture;
+        qint64 lastArrival;
+        bool eof;
+        bool shut;
+    };
+    struct Link {
+        Direction up;   // client to server
+        Direction down; // server to client
+    };
+
+    void accept();
+    void schedule(Direction& d, QByteArray data, qint64 now);
+    // false once the connection has failed
+    bool receive(Direction& d, qint64 now);
+    bool transmit(Direction& d, qint64 now);
+    qint64 oneWayDelay();
+
+    // stop reading from a side once this much is waiting to go out, so
+    // that a slow link pushes back on the sender
+    enum { MAX_QUEUED = 1 << 20, READ_SIZE = 64 * 1024 };
+
+    QByteArray host;
+    int remotePort;
+    LinkShape shape;
+    int sockListen;
+    int localPort;
+    int wakeFds[2];
+    QAtomicInt stopping;
+    QList<Link*> links;
+    QElapsedTimer clock;
+    std::minstd_rand random;
+};
+
+#endif // _SEQUELJOE_LATENCYPROXY_H_
@@ -6,11 +6,15 @@
  * for more information
  */
 #include "loadingoverlay.h"
+#include "savedconfig.h"
 
 #include <QPainter>
 #include <QPaintEvent>
 #include <QApplication>
 #include <QTimeLine>
+#include <QTimer>
+#include <QScreen>
+#include <QSettings>
 
 Spinner* LoadingOverlay::spinner = nullptr;
 
@@ -56,21 +60,47 @@ LoadingOverlay::LoadingOverlay(QWidget *parent) :
     if(spinner == nullptr)
         spinner = new Spinner(60, 50);
 
+    delay = new QTimer(this);
+    delay->setSingleShot(true);
+    delay->setInterval(QSettings().value(SavedConfig::KEY_LOADING_OVERLAY_DELAY, SavedConfig::DEFAULT_LOADING_OVERLAY_DELAY).toInt());
+    connect(delay, SIGNAL(timeout()), this, SLOT(show()));
+
+    // no point producing frames faster than the screen can show them
+    qreal hz = QGuiApplication::primaryScreen() ? QGuiApplication::primaryScreen()->refreshRate() : 60;
+    int interval = qMax(1000 / qMax(int(hz), 1), 16);
+
     timeline = new QTimeLine(1000);
     timeline->setFrameRange(0,360);
     timeline->setCurveShape(QTimeLine::LinearCurve);
-    connect(timeline, SIGNAL(frameChanged(int)), this, SLOT(repaint()));
+    timeline->setUpdateInterval(interval);
+    connect(timeline, SIGNAL(frameChanged(int)), this, SLOT(advance()));
     timeline->setLoopCount(0); // loop forever
 
     fade = new QTimeLine(400);
     fade->setFrameRange(0,255);
     fade->setCurveShape(QTimeLine::EaseInCurve);
-    connect(fade, SIGNAL(frameChanged(int)), this, SLOT(repaint()));
+    fade->setUpdateInterval(interval);
+    connect(fade, SIGNAL(frameChanged(int)), this, SLOT(update()));
 
 }
 
 LoadingOverlay::~LoadingOverlay() {
     delete timeline;
+    delete fade;
+}
+
+void LoadingOverlay::setLoading(bool loading) {
+    if(loading) {
+        if(!isVisible() && !delay->isActive())
+            delay->start();
+    } else {
+        delay->stop();
+        hide();
+    }
+}
+
+void LoadingOverlay::setDelay(int ms) {
+    delay->setInterval(ms);
 }
 
 void LoadingOverlay::showEvent(QShowEvent *e) {
@@ -85,18 +115,31 @@ void LoadingOverlay::hideEvent(QHideEvent * e) {
     fade->stop();
 }
 
+QRect LoadingOverlay::spinnerRect() const {
+    // the spinner is round, so rotating it never leaves this square
+    const QPixmap& px = spinner->pixmap();
+    QRect r(0, 0, px.width() + 2, px.height() + 2);
+    r.moveCenter(rect().center());
+    return r;
+}
+
+void LoadingOverlay::advance() {
+    // while fading in the whole overlay is repainted anyway
+    if(fade->state() != QTimeLine::Running)
+        update(spinnerRect());
+}
+
 void LoadingOverlay::paintEvent(QPaintEvent * e) {
     QWidget::paintEvent(e);
     QPainter painter(this);
-    QRect r = e->rect();
 
     painter.setOpacity(fade->currentFrame()/255.);
 
-    painter.fillRect(r, QColor(255,255,255,96));
+    painter.fillRect(e->rect(), QColor(255,255,255,96));
 
     const QPixmap& px = spinner->pixmap();
-    painter.translate(r.width()/2,r.height()/2);
+    QPoint c = spinnerRect().center();
+    painter.translate(c.x(), c.y());
     painter.rotate(timeline->currentFrame());
     painter.drawPixmap(-px.width()/2,-px.width()/2,spinner->pixmap());
 }
-
@@ -12,6 +12,7 @@
 
 class Spinner;
 class QTimeLine;
+class QTimer;
 
 class LoadingOverlay : public QWidget
 {
@@ -20,13 +21,24 @@ public:
     explicit LoadingOverlay(QWidget *parent = 0);
     virtual ~LoadingOverlay();
 
+    // show the overlay once loading has lasted longer than the delay. Loads
+    // that finish sooner never show it at all
+    void setLoading(bool loading);
+    void setDelay(int ms);
+
 protected:
     virtual void paintEvent(QPaintEvent *) override;
     virtual void showEvent(QShowEvent *) override;
     virtual void hideEvent(QHideEvent *) override;
 
+private slots:
+    void advance();
+
 private:
+    QRect spinnerRect() const;
+
     static Spinner* spinner;
+    QTimer* delay;
     QTimeLine* fade;
     QTimeLine* timeline;
 };
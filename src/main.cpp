@@ -8,13 +8,11 @@
 #include "mainwindow.h"
 #include "notify.h"
 #include "dbconnection.h"
-#include "tabledata.h"
-#include "foreignkey.h"
+#include "trace.h"
 
 #include <QApplication>
 #include <QProxyStyle>
 #include <QMenu>
-#include <QSqlQuery>
 
 #ifdef __APPLE__
 class MacFontStyle : public QProxyStyle {
@@ -32,11 +30,8 @@ int main(int argc, char *argv[]) {
 
     QApplication a(argc, argv);
 
-    qRegisterMetaType<ForeignKey>("ForeignKey");
-    qRegisterMetaType<QSqlQuery*>("QSqlQuery*");
-    qRegisterMetaType<const char*>("const char*");
-    qRegisterMetaType<TableMetadata>("TableMetadata");
-    qRegisterMetaType<Schema*>("Schema*");
+    DbConnection::registerMetaTypes();
+    Trace::startFromEnvironment();
 
 #ifdef __APPLE__
     // prevents the font size from appearing overly large on OSX
@@ -46,6 +41,8 @@ int main(int argc, char *argv[]) {
     MainWindow w;
     w.show();    
     a.exec();
+    if(Trace::isRecording())
+        Trace::stop();
     Notifier::cleanup();
     return 0;
 }
@@ -14,10 +14,13 @@
 #include "schemaview.h"
 #include "tablelist.h"
 #include "querylog.h"
+#include "statspanel.h"
 #include "loadingoverlay.h"
 #include "tablemodel.h"
 #include "schemamodel.h"
+#include "driver.h"
 #include "sqlhighlighter.h"
+#include "notify.h"
 
 #include <QSortFilterProxyModel>
 #include <QStringListModel>
@@ -35,12 +38,14 @@
 #include <QThread>
 #include <QDialog>
 #include <QPlainTextEdit>
+#include <QApplication>
 
 MainPanel::MainPanel(QWidget* parent) :
     QWidget(parent),
     db(nullptr)
 {
     backgroundWorker = new QThread;
+    backgroundWorker->setObjectName("Database worker");
     backgroundWorker->start();
 
     QGridLayout* layout = new QGridLayout(this);
@@ -109,9 +114,16 @@ MainPanel::MainPanel(QWidget* parent) :
                 }
                 splitLogViewer->addWidget(actionPanel);
             }
-            { // query log (bottom half of splitter)
+            { // query log and connection stats (bottom half of splitter)
+                QSplitter* splitStats = new QSplitter(Qt::Horizontal, this);
                 queryLog = new QueryLog(this);
-                splitLogViewer->addWidget(queryLog);
+                splitStats->addWidget(queryLog);
+                statsPanel = new StatsPanel(this);
+                statsPanel->hide(); // until toggled from the toolbar
+                splitStats->addWidget(statsPanel);
+                splitStats->setStretchFactor(0,3);
+                connect(toolbar, SIGNAL(statsToggled(bool)), statsPanel, SLOT(setVisible(bool)));
+                splitLogViewer->addWidget(splitStats);
             }
             layout->addWidget(splitLogViewer);
             splitLogViewer->setStretchFactor(0,5);
@@ -206,7 +218,7 @@ void MainPanel::deleteContentModel(QString table) {
 }
 
 void MainPanel::openConnection(QString name) {
-    loadingOverlay->show();
+    loadingOverlay->setLoading(true);
     QSettings s;
     s.beginGroup(name);
 
@@ -214,9 +226,11 @@ void MainPanel::openConnection(QString name) {
     db->moveToThread(backgroundWorker);
 
     connect(db, SIGNAL(queryExecuted(QString,QString)), queryLog, SLOT(logQuery(QString,QString)));
+    connect(db, SIGNAL(queryExecuted(QString,QString)), this, SLOT(notifyQueryExecuted(QString,QString)));
+    statsPanel->setConnection(db);
     connect(db, SIGNAL(connectionSuccess()), this, SLOT(databaseConnected()));
     connect(db, SIGNAL(connectionFailed(QString)), this, SLOT(connectionFailed(QString)));
-    connect(db, SIGNAL(confirmUnknownHost(QString,bool*)), this, SLOT(confirmUnknownHost(QString,bool*)), Qt::BlockingQueuedConnection);
+    connect(db, SIGNAL(confirmUnknownHost(QString)), this, SLOT(confirmUnknownHost(QString)));
 
     QString label = s.value("Name").toString();
     s.endGroup();
@@ -225,11 +239,12 @@ void MainPanel::openConnection(QString name) {
 
     connect(db, SIGNAL(databaseChanged(QString)), this, SLOT(tableListChanged()));
 
-    QMetaObject::invokeMethod(db, "start", Qt::QueuedConnection);
+    DbConnection* conn = db;
+    db->jobs().post(JobQueue::INTERACTIVE, "connect", [conn]{ conn->start(); });
 }
 
 void MainPanel::databaseConnected() {
-    loadingOverlay->hide();
+    loadingOverlay->setLoading(false);
     toolbar->enableViewActions();
 
     toggleEditSettings(false);
@@ -244,17 +259,26 @@ void MainPanel::databaseConnected() {
 
     SqlModel* m = new SqlModel(*db);
     queryWidget->setModel(m);
+    queryWidget->setHashComments(db->sqlDriver()->hashComments());
 }
 
 void MainPanel::connectionFailed(QString reason) {
     if(!reason.isNull())
         QMessageBox::critical(this, "Connection failed", reason);
-    loadingOverlay->hide();
+    loadingOverlay->setLoading(false);
+}
+
+void MainPanel::confirmUnknownHost(QString fingerprint) {
+    bool ok = QMessageBox::warning(this, "Unknown Server Host Key", "Server host key with fingerprint " + fingerprint + " does not exist in known_hosts file. Would you like to continue and add it?", QMessageBox::Yes, QMessageBox::Abort) == QMessageBox::Yes;
+    // the tab may have been disconnected meanwhile
+    if(db)
+        db->answerUnknownHost(ok);
 }
 
-void MainPanel::confirmUnknownHost(QString fingerprint, bool* ok) {
-    if(QMessageBox::warning(this, "Unknown Server Host Key", "Server host key with fingerprint " + fingerprint + " does not exist in known_hosts file. Would you like to continue and add it?", QMessageBox::Yes, QMessageBox::Abort) == QMessageBox::Yes)
-        *ok = true;
+void MainPanel::notifyQueryExecuted(QString query, QString result) {
+    // status messages about the connection itself come without a query
+    if(!query.isEmpty() && qApp->focusWindow() == 0)
+        Notifier::instance()->send("Query complete", result.toLocal8Bit().constData());
 }
 
 void MainPanel::tableListChanged() {
@@ -266,7 +290,8 @@ void MainPanel::dbChanged(QString name) {
     if(db->databaseName() != name) {
         contentView->setModel(nullptr);
         schemaView->setModel(nullptr);
-        QMetaObject::invokeMethod(db, "useDatabase", Q_ARG(QString, name));
+        DbConnection* conn = db;
+        db->jobs().post(JobQueue::INTERACTIVE, "useDatabase", [conn, name]{ conn->useDatabase(name); });
     }
 }
 
@@ -325,14 +350,25 @@ void MainPanel::disconnectDb() {
     toggleEditSettings(true);
     if(db) {
         disconnect(db);
+        statsPanel->setConnection(nullptr);
         qDeleteAll(contentModels);
         qDeleteAll(schemaModels);
         contentModels.clear();
         schemaModels.clear();
 
-        QMetaObject::invokeMethod(db, "cleanup", Qt::BlockingQueuedConnection);
-        //backgroundWorker_->exit();
-        delete db;
+        // what's still queued was for the models just deleted
+        db->jobs().clear();
+        DbConnection* conn = db;
+        db->jobs().post(JobQueue::INTERACTIVE, "disconnect", [conn]{
+            conn->cleanup();
+            conn->deleteLater();
+        });
+        // if the panel is closed the worker may stop before that job runs.
+        // finished is emitted on the worker, so this still runs there
+        connect(backgroundWorker, &QThread::finished, conn, [conn]{
+            conn->cleanup();
+            delete conn;
+        });
         db = 0;
     }
 }
@@ -340,47 +376,69 @@ void MainPanel::disconnectDb() {
 void MainPanel::addTable() {
     QString name = QInputDialog::getText(this, "Create Table", "Enter a name for the new table");
     if(!name.isEmpty()) {
-        QMetaObject::invokeMethod(db, "createTable", Qt::BlockingQueuedConnection, Q_ARG(QString, name));
-        refreshTables(); // todo fake it?
-        tableChooser->setCurrentTable(name);
-        toolbar->triggerPanelOpen(ViewToolBar::PANEL_STRUCTURE);
-        //openPanel(ViewToolBar::PANEL_STRUCTURE, name);
+        DbConnection* conn = db;
+        db->jobs().submit(JobQueue::INTERACTIVE, "createTable", [conn, name]{
+            conn->createTable(name);
+            return conn->populateTables();
+        }).then(this, [this, conn, name](QStringList tables){
+            if(db != conn)
+                return;
+            tableChooser->setTableNames(tables);
+            tableChooser->setCurrentTable(name);
+            toolbar->triggerPanelOpen(ViewToolBar::PANEL_STRUCTURE);
+        });
     }
 }
 
 void MainPanel::deleteTable() {
     QString current = tableChooser->selectedTable();
     if(!current.isNull() && QMessageBox::warning(this, QString("Delete Table"), "Are you sure? This action cannot be undone", QMessageBox::Yes | QMessageBox::Cancel) == QMessageBox::Yes) {
-        QMetaObject::invokeMethod(db, "deleteTable", Qt::BlockingQueuedConnection, Q_ARG(QString, current));
         contentView->setModel(nullptr);
         schemaView->setModel(nullptr);
-        refreshTables();
+        DbConnection* conn = db;
+        db->jobs().submit(JobQueue::INTERACTIVE, "deleteTable", [conn, current]{
+            conn->deleteTable(current);
+            return conn->populateTables();
+        }).then(this, [this, conn](QStringList tables){
+            if(db == conn)
+                tableChooser->setTableNames(tables);
+        });
     }
 }
 
 void MainPanel::showCreateTable() {
     QString current = tableChooser->selectedTable();
     if(!current.isNull()) {
-        QString res;
-        QMetaObject::invokeMethod(db, "queryCreateTable", Qt::BlockingQueuedConnection, Q_RETURN_ARG(QString, res), Q_ARG(QString, current));
-        QDialog* dialog = new QDialog(this);
-        dialog->setWindowTitle("SHOW CREATE TABLE \"" + current + "\"");
-        dialog->setLayout(new QVBoxLayout(dialog));
-        QPlainTextEdit* txt = new QPlainTextEdit(dialog);
-        dialog->layout()->addWidget(txt);
-        new SqlHighlighter(txt->document());
-        txt->document()->setPlainText(res);
-        txt->setReadOnly(true);
-        QRect g = window()->geometry();
-        dialog->setGeometry(g.x()+g.width()/8, g.y()+g.height()/8,g.width()*3/4,g.height()*3/4);
-        dialog->setModal(true);
-        dialog->exec();
-        delete dialog;
+        DbConnection* conn = db;
+        db->jobs().submit(JobQueue::INTERACTIVE, "showCreateTable", [conn, current]{
+            return conn->queryCreateTable(current);
+        }).then(this, [this, current](QString res){ showCreateTableComplete(current, res); });
     }
 }
 
+void MainPanel::showCreateTableComplete(QString table, QString createStatement) {
+    QDialog* dialog = new QDialog(this);
+    dialog->setWindowTitle("SHOW CREATE TABLE \"" + table + "\"");
+    dialog->setLayout(new QVBoxLayout(dialog));
+    QPlainTextEdit* txt = new QPlainTextEdit(dialog);
+    dialog->layout()->addWidget(txt);
+    new SqlHighlighter(txt->document());
+    txt->document()->setPlainText(createStatement);
+    txt->setReadOnly(true);
+    QRect g = window()->geometry();
+    dialog->setGeometry(g.x()+g.width()/8, g.y()+g.height()/8,g.width()*3/4,g.height()*3/4);
+    dialog->setModal(true);
+    dialog->exec();
+    delete dialog;
+}
+
 void MainPanel::refreshTables() {
-    QMetaObject::invokeMethod(db, "populateTables", Qt::BlockingQueuedConnection);
-    tableChooser->setTableNames(db->tables());
+    DbConnection* conn = db;
+    db->jobs().submit(JobQueue::INTERACTIVE, "tables", [conn]{
+        return conn->populateTables();
+    }).then(this, [this, conn](QStringList tables){
+        if(db == conn)
+            tableChooser->setTableNames(tables);
+    });
 }
 
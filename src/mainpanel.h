@@ -32,6 +32,8 @@ class QSortFilterProxyModel;
 class QueryPanel;
 class QSplitter;
 class QThread;
+class LoadingOverlay;
+class StatsPanel;
 
 class MainPanel : public QWidget
 {
@@ -69,7 +71,8 @@ private slots:
 
     void databaseConnected();
     void connectionFailed(QString reason);
-    void confirmUnknownHost(QString fingerprint, bool* ok);
+    void confirmUnknownHost(QString fingerprint);
+    void notifyQueryExecuted(QString query, QString result);
 
     void tableListChanged();
     void deleteContentModel(QString table);
@@ -78,10 +81,11 @@ private:
     QString currentTable() const;
     void updateContentModel(QString tableName);
     void updateSchemaModel(QString tableName);
+    void showCreateTableComplete(QString table, QString createStatement);
 
     DbConnection* db;
     QThread* backgroundWorker;
-    QWidget* loadingOverlay;
+    LoadingOverlay* loadingOverlay;
 
     QHash<QString, TableModel*> contentModels;
     QHash<QString, SqlSchemaModel*> schemaModels;
@@ -95,6 +99,7 @@ private:
     ViewToolBar* toolbar;
     QueryPanel* queryWidget;
     QueryLog* queryLog;
+    StatsPanel* statsPanel;
 
     struct HistoryEntry {
         QString table;
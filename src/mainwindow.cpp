@@ -9,10 +9,13 @@
 
 #include "tabwidget.h"
 #include "mainpanel.h"
+#include "trace.h"
 
 #include <QSqlTableModel>
 #include <QSettings>
 #include <QMenuBar>
+#include <QFileDialog>
+#include <QMessageBox>
 #include <QVBoxLayout>
 #include <QPushButton>
 
@@ -25,6 +28,11 @@ MainWindow::MainWindow(QWidget* parent) :
         QMenuBar* menuBar = new QMenuBar(this);
         //QMenu* db = menuBar->addMenu("Database");
         //db->addAction("test", this, );
+        QMenu* debug = menuBar->addMenu("Debug");
+        QAction* trace = debug->addAction("Record Trace");
+        trace->setCheckable(true);
+        trace->setChecked(Trace::isRecording());
+        connect(trace, SIGNAL(toggled(bool)), this, SLOT(toggleTrace(bool)));
         setMenuBar(menuBar);
     }
 
@@ -53,6 +61,26 @@ void MainWindow::closeEvent(QCloseEvent*) {
     s.setValue("geometry", saveGeometry());
 }
 
+// Records where the time goes, e.g. when opening a table is slow, for
+// chrome://tracing or ui.perfetto.dev
+void MainWindow::toggleTrace(bool record) {
+    if(record) {
+        QString path = QFileDialog::getSaveFileName(this, "Record Trace To", "sequeljoe-trace.json", "Trace (*.json)");
+        if(path.isEmpty()) {
+            QAction* action = qobject_cast<QAction*>(sender());
+            action->blockSignals(true);
+            action->setChecked(false);
+            action->blockSignals(false);
+            return;
+        }
+        Trace::start(path);
+    } else {
+        QString error;
+        if(!Trace::stop(&error))
+            QMessageBox::warning(this, "Could not save trace", error);
+    }
+}
+
 void MainWindow::newTab() {
     MainPanel* w = new MainPanel(this);
     connect(w, SIGNAL(nameChanged(QWidget*,QString)), this, SLOT(updateTabName(QWidget*,QString)));
@@ -25,6 +25,7 @@ private slots:
     void handleTabChanged(int);
     void newTab();
     void handleTabClosed(int index);
+    void toggleTrace(bool record);
 
     virtual void closeEvent(QCloseEvent *);
 
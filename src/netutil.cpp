@@ -0,0 +1,225 @@
+/*
+ * Copyright 2014 Oliver Giles
+ *
+ * This file is part of SequelJoe. SequelJoe is licensed under the
+ * GNU GPL version 3. See LICENSE or <http://www.gnu.org/licenses/>
+ * for more information
+ */
+#ifdef _WIN32
+#include <winsock2.h>
+#include <windows.h>
+#include <ws2tcpip.h>
+#define poll WSAPoll
+#else
+#include <sys/socket.h>
+#include <poll.h>
+#include <netdb.h>
+#include <netinet/in.h>
+#include <arpa/inet.h>
+#include <fcntl.h>
+#include <unistd.h>
+#endif
+
+#include <errno.h>
+#include <string.h>
+
+#include <QElapsedTimer>
+#include <QVector>
+
+#include "netutil.h"
+
+void closeSocket(int fd) {
+    if(fd < 0)
+        return;
+#ifdef _WIN32
+    closesocket(fd);
+#else
+    close(fd);
+#endif
+}
+
+bool setNonBlocking(int fd, bool nonBlocking) {
+#ifdef _WIN32
+    u_long mode = nonBlocking ? 1 : 0;
+    return ioctlsocket(fd, FIONBIO, &mode) == 0;
+#else
+    int flags = fcntl(fd, F_GETFL, 0);
+    if(flags == -1)
+        return false;
+    flags = nonBlocking ? (flags | O_NONBLOCK) : (flags & ~O_NONBLOCK);
+    return fcntl(fd, F_SETFL, flags) == 0;
+#endif
+}
+
+bool wouldBlock() {
+#ifdef _WIN32
+    return WSAGetLastError() == WSAEWOULDBLOCK;
+#else
+    return errno == EAGAIN || errno == EWOULDBLOCK || errno == EINTR;
+#endif
+}
+
+bool socketPair(int fds[2]) {
+#ifdef _WIN32
+    int l = socket(AF_INET, SOCK_STREAM, IPPROTO_TCP);
+    struct sockaddr_in sin = {0};
+    sin.sin_family = AF_INET;
+    sin.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    int len = sizeof(sin);
+    bool ok = l >= 0 && bind(l, (struct sockaddr*)&sin, len) == 0 && listen(l, 1) == 0 &&
+            getsockname(l, (struct sockaddr*)&sin, &len) == 0 &&
+            (fds[1] = socket(AF_INET, SOCK_STREAM, IPPROTO_TCP)) >= 0 &&
+            ::connect(fds[1], (struct sockaddr*)&sin, len) == 0 &&
+            (fds[0] = accept(l, nullptr, nullptr)) >= 0;
+    closeSocket(l);
+    return ok;
+#else
+    return socketpair(AF_UNIX, SOCK_STREAM, 0, fds) == 0;
+#endif
+}
+
+static int lastSocketError() {
+#ifdef _WIN32
+    return WSAGetLastError();
+#else
+    return errno;
+#endif
+}
+
+static bool connectInProgress() {
+#ifdef _WIN32
+    return WSAGetLastError() == WSAEWOULDBLOCK;
+#else
+    return errno == EINPROGRESS;
+#endif
+}
+
+// The resolved addresses with the families alternating, starting with
+// whichever the resolver preferred
+static QVector<struct addrinfo*> interleave(struct addrinfo* res) {
+    QVector<struct addrinfo*> first, second;
+    for(struct addrinfo* p = res; p; p = p->ai_next)
+        (p->ai_family == res->ai_family ? first : second).append(p);
+    QVector<struct addrinfo*> ordered;
+    for(int i = 0; i < qMax(first.count(), second.count()); ++i) {
+        if(i < first.count())
+            ordered.append(first.at(i));
+        if(i < second.count())
+            ordered.append(second.at(i));
+    }
+    return ordered;
+}
+
+int connectTcp(const char* host, const char* port, int timeoutMs, QString* error,
+        const QAtomicInt* cancelled, int cancelFd) {
+    struct addrinfo* res;
+    struct addrinfo hints = {0};
+    hints.ai_family = AF_UNSPEC;
+    hints.ai_socktype = SOCK_STREAM;
+    hints.ai_protocol = IPPROTO_TCP;
+    hints.ai_flags = AI_ADDRCONFIG;
+    int rc = getaddrinfo(host, port, &hints, &res);
+    if(rc != 0) {
+#ifdef _WIN32
+        *error = gai_strerror(rc);
+#else
+        *error = rc == EAI_SYSTEM ? strerror(errno) : gai_strerror(rc);
+#endif
+        return -1;
+    }
+
+    QVector<struct addrinfo*> candidates = interleave(res);
+    // fds[0] is the cancel socket, the rest are attempts in progress
+    QVector<struct pollfd> fds(1);
+    fds[0].fd = cancelFd;
+    fds[0].events = POLLIN;
+    int next = 0;
+    int lastError = ETIMEDOUT;
+    int connected = -1;
+    // an attempt failed, so the next needn't wait out its head start
+    bool startNext = false;
+    QElapsedTimer elapsed, sinceAttempt;
+    elapsed.start();
+
+    while(connected < 0 && !elapsed.hasExpired(timeoutMs)) {
+        if(cancelled && cancelled->load()) {
+            lastError = ECANCELED;
+            break;
+        }
+        // start the next attempt once the previous has had its head start,
+        // or right away when one has failed (RFC 8305 section 5)
+        if(next < candidates.count() && (fds.count() == 1 || startNext || sinceAttempt.hasExpired(CONNECT_ATTEMPT_DELAY))) {
+            struct addrinfo* p = candidates.at(next++);
+            sinceAttempt.start();
+            startNext = false;
+            int fd = socket(p->ai_family, p->ai_socktype, p->ai_protocol);
+            if(fd < 0 || !setNonBlocking(fd)) {
+                lastError = lastSocketError();
+                closeSocket(fd);
+                startNext = true;
+                continue;
+            }
+            if(::connect(fd, p->ai_addr, p->ai_addrlen) == 0) {
+                connected = fd;
+                break;
+            }
+            if(!connectInProgress()) {
+                lastError = lastSocketError();
+                closeSocket(fd);
+                startNext = true;
+                continue;
+            }
+            struct pollfd pfd;
+            pfd.fd = fd;
+            pfd.events = POLLOUT;
+            pfd.revents = 0;
+            fds.append(pfd);
+        }
+        if(fds.count() == 1 && next == candidates.count())
+            break; // every address failed
+
+        qint64 wait = timeoutMs - elapsed.elapsed();
+        if(next < candidates.count())
+            wait = qMin(wait, CONNECT_ATTEMPT_DELAY - sinceAttempt.elapsed());
+        for(struct pollfd& pfd : fds)
+            pfd.revents = 0;
+        // a negative fd (no cancel socket) is ignored by poll
+        if(poll(fds.data(), fds.count(), int(qMax<qint64>(wait, 0))) < 0 && !wouldBlock()) {
+            lastError = lastSocketError();
+            break;
+        }
+        if(fds[0].revents & POLLIN) {
+            char buf[64];
+            while(recv(cancelFd, buf, sizeof(buf), 0) > 0)
+                ;
+            continue; // checked at the top
+        }
+        for(int i = 1; i < fds.count(); ++i) {
+            if(!fds[i].revents)
+                continue;
+            int err = 0;
+            socklen_t len = sizeof(err);
+            getsockopt(fds[i].fd, SOL_SOCKET, SO_ERROR, (char*) &err, &len);
+            if(err == 0 && connected < 0) {
+                connected = fds[i].fd;
+            } else {
+                if(err)
+                    lastError = err;
+                closeSocket(fds[i].fd);
+                startNext = true;
+            }
+            fds.remove(i--);
+        }
+    }
+
+    for(int i = 1; i < fds.count(); ++i)
+        closeSocket(fds[i].fd);
+    freeaddrinfo(res);
+
+    if(connected < 0) {
+        *error = strerror(lastError);
+        return -1;
+    }
+    setNonBlocking(connected, false);
+    return connected;
+}
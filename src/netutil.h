@@ -0,0 +1,37 @@
+/*
+ * Copyright 2014 Oliver Giles
+ *
+ * This file is part of SequelJoe. SequelJoe is licensed under the
+ * GNU GPL version 3. See LICENSE or <http://www.gnu.org/licenses/>
+ * for more information
+ */
+#ifndef _SEQUELJOE_NETUTIL_H_
+#define _SEQUELJOE_NETUTIL_H_
+
+#include <QString>
+#include <QAtomicInt>
+
+// Small portable wrappers for the raw sockets used by the SSH tunnel
+
+void closeSocket(int fd);
+bool setNonBlocking(int fd, bool nonBlocking = true);
+// whether the last socket call failed only because it would have blocked
+bool wouldBlock();
+// a connected pair of sockets, used to wake a poll() loop from another
+// thread. WSAPoll only accepts sockets, so on Windows this goes over loopback
+bool socketPair(int fds[2]);
+
+// Connects to host:port over TCP, racing the resolved IPv4 and IPv6
+// addresses as in RFC 8305 ("Happy Eyeballs"): families are interleaved and
+// a new attempt starts every CONNECT_ATTEMPT_DELAY ms, or as soon as the
+// previous one fails, while earlier attempts keep going. The first to
+// succeed wins. Gives up after timeoutMs, or early once cancelled is set;
+// cancelFd, if given, is a non-blocking socket written to after setting it,
+// and is drained when it wakes us. Returns a blocking socket, or -1 with
+// the reason in error
+int connectTcp(const char* host, const char* port, int timeoutMs, QString* error,
+        const QAtomicInt* cancelled = nullptr, int cancelFd = -1);
+
+enum { CONNECT_ATTEMPT_DELAY = 250 };
+
+#endif // _SEQUELJOE_NETUTIL_H_
@@ -9,7 +9,9 @@
 
 #include "tableview.h"
 #include "sqlhighlighter.h"
+#include "statementindex.h"
 #include "sqlmodel.h"
+#include "savedconfig.h"
 #include <QDebug>
 #include <QSplitter>
 #include <QTableView>
@@ -21,6 +23,7 @@
 #include <QSqlQuery>
 #include <QLabel>
 #include <QAction>
+#include <QSettings>
 
 
 QueryPanel::QueryPanel(QWidget* parent) :
@@ -42,7 +45,8 @@ QueryPanel::QueryPanel(QWidget* parent) :
         editor = new QPlainTextEdit(this);
         QFont f;
         f.setStyleHint(QFont::Monospace);
-        new SqlHighlighter(editor->document());
+        highlighter = new SqlHighlighter(editor->document());
+        statements = new StatementIndex(editor->document());
         editor->setFont(f);
         editorLayout->addWidget(editor);
 
@@ -121,46 +125,27 @@ void QueryPanel::setModel(SqlModel *m) {
     if(model)
         delete model;
     model = m;
+    if(m)
+        m->setMemoryBudget(QSettings().value(SavedConfig::KEY_RESULT_MEMORY_BUDGET, SavedConfig::DEFAULT_RESULT_MEMORY_BUDGET).toLongLong());
     results->setModel(m);
 }
-union State {
-    struct {
-        char mode;
-        char idx;
-        char col;
-    } s;
-    int opaque;
-};
-QString QueryPanel::getActiveStatement(int block, int col) {
-    int from = 0, to = -1;
-    QString sql;
-
-    QTextBlock b = editor->document()->findBlockByNumber(block);
-    if(b.isValid()) {
-        to = b.position() + b.length();
-    }
-    else {
-        return sql;
-    }
 
-    b = b.previous();
-    while (b.isValid()) {
-        if (b.text().endsWith(";")){
-            from = b.position() + b.length();
-            break;
-        }
-        else {
-           from = b.position();
-        }
-        b = b.previous();
-    }
-    QString all = editor->document()->toPlainText();
-    return all.mid(from, to).trimmed();
+void QueryPanel::setHashComments(bool enable) {
+    highlighter->setHashComments(enable);
+    statements->setHashComments(enable);
+}
+
+QString QueryPanel::getActiveStatement(int position) {
+    StatementIndex::Range r = statements->statementAt(position);
+    QTextCursor c(editor->document());
+    c.setPosition(r.from);
+    c.setPosition(r.to, QTextCursor::KeepAnchor);
+    return c.selectedText().replace(QChar::ParagraphSeparator, '\n').trimmed();
 }
 
 void QueryPanel::executeQuery() {
     QTextCursor c = editor->textCursor();
-    QString stmt = getActiveStatement(c.blockNumber(), c.columnNumber());
+    QString stmt = getActiveStatement(c.position());
     error->hide();
     status->hide();
     if (stmt.isEmpty()){qDebug() << "empty query"; return;}
@@ -12,6 +12,8 @@
 
 class TableView;
 class SqlModel;
+class StatementIndex;
+class SqlHighlighter;
 
 class QSqlQueryModel;
 class QPlainTextEdit;
@@ -25,14 +27,18 @@ class QueryPanel: public QWidget
 public:
     QueryPanel(QWidget* parent = 0);
     void setModel(SqlModel *model);
+    // whether the database takes # to start a comment, see SqlLexer
+    void setHashComments(bool enable);
 
 private slots:
     void executeQuery();
     void executeAll();
 
 private:
-    QString getActiveStatement(int b,int c);
+    QString getActiveStatement(int position);
     QPlainTextEdit* editor;
+    SqlHighlighter* highlighter;
+    StatementIndex* statements;
     QLabel* error;
     QLabel* status;
     TableView* results;
@@ -0,0 +1,275 @@
+/*
+ * Copyright 2014 Oliver Giles
+ *
+ * This file is part of SequelJoe. SequelJoe is licensed under the
+ * GNU GPL version 3. See LICENSE or <http://www.gnu.org/licenses/>
+ * for more information
+ */
+#include "recordview.h"
+#include "tablecell.h"
+#include "roles.h"
+#include "fontmetrics.h"
+
+#include <QAbstractTableModel>
+#include <QTableView>
+#include <QHeaderView>
+#include <QVBoxLayout>
+#include <QHBoxLayout>
+#include <QLineEdit>
+#include <QLabel>
+#include <QPushButton>
+
+// One row per (matching) column of the source model, showing the field name
+// and its value in a single source row
+class RecordModel : public QAbstractTableModel {
+    Q_OBJECT
+public:
+    enum { COLUMN_FIELD, COLUMN_VALUE, NUM_COLUMNS };
+
+    RecordModel(QObject* parent = 0) :
+        QAbstractTableModel(parent),
+        source(nullptr),
+        row(0)
+    {}
+
+    void setSourceModel(QAbstractItemModel* m) {
+        beginResetModel();
+        if(source)
+            disconnect(source, 0, this, 0);
+        source = m;
+        if(source) {
+            connect(source, &QAbstractItemModel::modelAboutToBeReset, this, &RecordModel::beginResetModel);
+            connect(source, &QAbstractItemModel::modelReset, this, &RecordModel::sourceReset);
+            connect(source, &QAbstractItemModel::dataChanged, this, &RecordModel::sourceDataChanged);
+            connect(source, &QAbstractItemModel::rowsInserted, this, &RecordModel::recordsChanged);
+            connect(source, &QAbstractItemModel::rowsRemoved, this, &RecordModel::recordsChanged);
+        }
+        loadFields();
+        endResetModel();
+        emit recordsChanged();
+    }
+
+    int records() const { return source ? source->rowCount() : 0; }
+    int record() const { return row; }
+    void setRecord(int r) {
+        row = r;
+        if(!matching.isEmpty())
+            emit dataChanged(index(0, COLUMN_VALUE), index(matching.count() - 1, COLUMN_VALUE));
+    }
+
+    int rowCount(const QModelIndex& parent = QModelIndex()) const override {
+        return parent.isValid() ? 0 : matching.count();
+    }
+    int columnCount(const QModelIndex& parent = QModelIndex()) const override {
+        return parent.isValid() ? 0 : NUM_COLUMNS;
+    }
+
+    QVariant data(const QModelIndex& idx, int role) const override {
+        if(!idx.isValid() || idx.row() >= matching.count())
+            return QVariant();
+        int field = matching.at(idx.row());
+        if(idx.column() == COLUMN_FIELD) {
+            if(role == Qt::DisplayRole)
+                return names.at(field);
+            if(role == Qt::ToolTipRole)
+                return types.at(field);
+            return QVariant();
+        }
+        QModelIndex src = sourceIndex(idx);
+        // numbers line up better on the right
+        if(role == Qt::TextAlignmentRole && isNumeric(types.at(field)))
+            return int(Qt::AlignRight | Qt::AlignVCenter);
+        // the grid handles expansion, not worth it here
+        if(role == ForeignKeyRole)
+            return QVariant();
+        return src.isValid() ? src.data(role) : QVariant();
+    }
+
+    bool setData(const QModelIndex& idx, const QVariant& value, int role) override {
+        QModelIndex src = sourceIndex(idx);
+        return src.isValid() && source->setData(src, value, role);
+    }
+
+    Qt::ItemFlags flags(const QModelIndex& idx) const override {
+        QModelIndex src = sourceIndex(idx);
+        if(!src.isValid())
+            return Qt::ItemIsEnabled | Qt::ItemIsSelectable;
+        // the hex viewer needs the source model
+        if(src.data(EditorTypeRole).toInt() == SJCellEditBinary)
+            return source->flags(src) & ~Qt::ItemIsEditable;
+        return source->flags(src);
+    }
+
+    QVariant headerData(int section, Qt::Orientation orientation, int role) const override {
+        if(orientation == Qt::Horizontal && role == Qt::DisplayRole)
+            return section == COLUMN_FIELD ? "Field" : "Value";
+        return QVariant();
+    }
+
+    // the widest field name, for sizing the first column without measuring every row
+    QString longestName() const { return longest; }
+
+public slots:
+    void setFilter(QString text) {
+        beginResetModel();
+        filter = text.toLower();
+        applyFilter();
+        endResetModel();
+    }
+
+signals:
+    void recordsChanged();
+
+private slots:
+    void sourceReset() {
+        loadFields();
+        endResetModel();
+        emit recordsChanged();
+    }
+
+    void sourceDataChanged(const QModelIndex& tl, const QModelIndex& br) {
+        if(tl.parent().isValid() || row < tl.row() || row > br.row() || matching.isEmpty())
+            return;
+        emit dataChanged(index(0, COLUMN_VALUE), index(matching.count() - 1, COLUMN_VALUE));
+    }
+
+private:
+    QModelIndex sourceIndex(const QModelIndex& idx) const {
+        if(!source || !idx.isValid() || idx.column() != COLUMN_VALUE || idx.row() >= matching.count())
+            return QModelIndex();
+        return source->index(row, matching.at(idx.row()));
+    }
+
+    static bool isNumeric(const QString& type) {
+        static const char* numeric[] = { "int", "serial", "decimal", "numeric", "real", "double", "float", "money" };
+        for(const char* n : numeric)
+            if(type.contains(n, Qt::CaseInsensitive))
+                return true;
+        return false;
+    }
+
+    void loadFields() {
+        names.clear();
+        lowerNames.clear();
+        types.clear();
+        longest.clear();
+        int n = source ? source->columnCount() : 0;
+        for(int i = 0; i < n; ++i) {
+            QString name = source->headerData(i, Qt::Horizontal).toString();
+            names << name;
+            lowerNames << name.toLower();
+            types << source->headerData(i, Qt::Horizontal, ColumnTypeRole).toString();
+            if(name.length() > longest.length())
+                longest = name;
+        }
+        applyFilter();
+    }
+
+    void applyFilter() {
+        matching.clear();
+        for(int i = 0; i < lowerNames.count(); ++i)
+            if(filter.isEmpty() || lowerNames.at(i).contains(filter))
+                matching << i;
+    }
+
+    QAbstractItemModel* source;
+    int row;
+    QString filter;
+    QStringList names;
+    QStringList lowerNames;
+    QStringList types;
+    QString longest;
+    // indices of the source columns matching the filter
+    QVector<int> matching;
+};
+
+// Like TableView, fetches the rest of a truncated value for its editor
+class FieldTable : public QTableView {
+public:
+    explicit FieldTable(QWidget* parent) : QTableView(parent) {}
+
+protected:
+    bool edit(const QModelIndex& index, EditTrigger trigger, QEvent* event) override {
+        if(!QTableView::edit(index, trigger, event))
+            return false;
+        if(index.data(ValueTruncatedRole).toBool())
+            model()->setData(index, QVariant(), FetchFullValueRole);
+        return true;
+    }
+};
+
+RecordView::RecordView(QWidget *parent) :
+    QWidget(parent),
+    record(new RecordModel(this))
+{
+    QBoxLayout* layout = new QVBoxLayout(this);
+    layout->setContentsMargins(0,0,0,0);
+
+    QBoxLayout* bar = new QHBoxLayout();
+    search = new QLineEdit(this);
+    search->setPlaceholderText("Find field");
+    connect(search, SIGNAL(textChanged(QString)), record, SLOT(setFilter(QString)));
+    prev = new QPushButton("<", this);
+    prev->setMaximumWidth(prev->sizeHint().height());
+    connect(prev, SIGNAL(clicked()), this, SLOT(prevRecord()));
+    next = new QPushButton(">", this);
+    next->setMaximumWidth(next->sizeHint().height());
+    connect(next, SIGNAL(clicked()), this, SLOT(nextRecord()));
+    position = new QLabel(this);
+    bar->addWidget(search, 1);
+    bar->addWidget(prev);
+    bar->addWidget(position);
+    bar->addWidget(next);
+    layout->addLayout(bar);
+
+    fields = new FieldTable(this);
+    fields->setModel(record);
+    fields->setItemDelegate(new TableCell(fields));
+    fields->setAlternatingRowColors(true);
+    fields->setWordWrap(false);
+    fields->verticalHeader()->hide();
+    // fixed row heights keep layout independent of the number of fields
+    fields->verticalHeader()->setSectionResizeMode(QHeaderView::Fixed);
+    fields->verticalHeader()->setDefaultSectionSize(fields->fontMetrics().height() + 6);
+    fields->horizontalHeader()->setStretchLastSection(true);
+    layout->addWidget(fields);
+
+    connect(record, SIGNAL(recordsChanged()), this, SLOT(updateNavigation()));
+    connect(record, SIGNAL(modelReset()), this, SLOT(updateNavigation()));
+}
+
+void RecordView::setModel(QAbstractItemModel* model) {
+    record->setSourceModel(model);
+    setCurrentRecord(0);
+}
+
+int RecordView::currentRecord() const {
+    return record->record();
+}
+
+void RecordView::setCurrentRecord(int row) {
+    record->setRecord(qBound(0, row, qMax(record->records() - 1, 0)));
+    updateNavigation();
+}
+
+void RecordView::nextRecord() {
+    setCurrentRecord(currentRecord() + 1);
+}
+
+void RecordView::prevRecord() {
+    setCurrentRecord(currentRecord() - 1);
+}
+
+void RecordView::updateNavigation() {
+    int n = record->records();
+    if(record->record() >= n && n > 0)
+        record->setRecord(n - 1);
+    prev->setEnabled(record->record() > 0);
+    next->setEnabled(record->record() + 1 < n);
+    position->setText(n ? "Record " + QString::number(record->record() + 1) + " of " + QString::number(n) : "No Records");
+    QFontMetrics fm = fields->fontMetrics();
+    int nameWidth = horizontalAdvance(fm, record->longestName() + "00");
+    fields->horizontalHeader()->resizeSection(RecordModel::COLUMN_FIELD, qBound(80, nameWidth, 300));
+}
+
+#include "recordview.moc"
@@ -0,0 +1,48 @@
+/*
+ * Copyright 2014 Oliver Giles
+ *
+ * This file is part of SequelJoe. SequelJoe is licensed under the
+ * GNU GPL version 3. See LICENSE or <http://www.gnu.org/licenses/>
+ * for more information
+ */
+#ifndef _SEQUELJOE_RECORDVIEW_H_
+#define _SEQUELJOE_RECORDVIEW_H_
+
+#include <QWidget>
+
+class RecordModel;
+class QTableView;
+class QLineEdit;
+class QLabel;
+class QAbstractButton;
+class QAbstractItemModel;
+
+// Shows one record of a model at a time as field/value pairs, one field per
+// line. Meant for tables too wide to read in the grid: only the visible
+// fields are ever laid out, and the fields can be narrowed down by name.
+class RecordView : public QWidget {
+    Q_OBJECT
+public:
+    explicit RecordView(QWidget *parent = 0);
+
+    void setModel(QAbstractItemModel* model);
+    int currentRecord() const;
+
+public slots:
+    void setCurrentRecord(int row);
+
+private slots:
+    void nextRecord();
+    void prevRecord();
+    void updateNavigation();
+
+private:
+    RecordModel* record;
+    QTableView* fields;
+    QLineEdit* search;
+    QLabel* position;
+    QAbstractButton* prev;
+    QAbstractButton* next;
+};
+
+#endif // _SEQUELJOE_RECORDVIEW_H_
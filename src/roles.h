@@ -5,7 +5,8 @@
 
 enum SequelJoeCellEditors {
     SJCellEditDefault = 0,
-    SJCellEditLongText
+    SJCellEditLongText,
+    SJCellEditBinary
 };
 
 enum SequelJoeCustomRoles {
@@ -17,8 +18,11 @@ enum SequelJoeCustomRoles {
     ForeignKeyRole,
     TableNameRole,
     ExpandedColumnIndexRole,
-    HeightMultiple,
-    EditorTypeRole
+    EditorTypeRole,
+    ColumnCharWidthRole, // header only: estimated content width in characters
+    ColumnTypeRole, // header only: the column's SQL type, if known
+    ValueTruncatedRole, // only a prefix of the value has been fetched
+    FetchFullValueRole // setData with this role to fetch the whole value
 };
 
 
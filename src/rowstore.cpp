@@ -0,0 +1,153 @@
+/*
+ * Copyright 2014 Oliver Giles
+ *
+ * This file is part of SequelJoe. SequelJoe is licensed under the
+ * GNU GPL version 3. See LICENSE or <http://www.gnu.org/licenses/>
+ * for more information
+ */
+#include "rowstore.h"
+
+#include <QTemporaryFile>
+#include <QDataStream>
+#include <QDir>
+
+RowStore::RowStore(qint64 memoryBudget) :
+    budget(memoryBudget),
+    nRows(0),
+    residentBytes(0),
+    useClock(0),
+    spillFile(nullptr)
+{
+}
+
+RowStore::~RowStore() {
+    delete spillFile;
+}
+
+void RowStore::setMemoryBudget(qint64 bytes) {
+    budget = bytes;
+    enforceBudget(nullptr);
+}
+
+void RowStore::clear() {
+    blocks.clear();
+    nRows = 0;
+    residentBytes = 0;
+    // the old contents are garbage, start a fresh file when next needed
+    delete spillFile;
+    spillFile = nullptr;
+}
+
+void RowStore::append(const ResultRows& rows) {
+    for(const QVector<QVariant>& row : rows) {
+        // all blocks but the last are full
+        if(nRows % BLOCK_ROWS == 0)
+            blocks.append(Block{});
+        Block& b = blocks.last();
+        if(!b.resident)
+            pageIn(b);
+        qint64 sz = estimateSize(row);
+        b.rows.append(row);
+        b.bytes += sz;
+        // the block changed, so any spilled copy is stale
+        b.offset = -1;
+        b.lastUse = ++useClock;
+        residentBytes += sz;
+        nRows++;
+    }
+    enforceBudget(blocks.isEmpty() ? nullptr : &blocks.last());
+}
+
+QVariant RowStore::value(int row, int col) const {
+    Block& b = block(row);
+    return b.rows.at(row % BLOCK_ROWS).value(col);
+}
+
+RowStore::Block& RowStore::block(int row) const {
+    Block& b = blocks[row / BLOCK_ROWS];
+    b.lastUse = ++useClock;
+    if(!b.resident) {
+        pageIn(b);
+        enforceBudget(&b);
+    }
+    return b;
+}
+
+void RowStore::pageIn(Block& b) const {
+    uchar* p = spillFile->map(b.offset, b.length);
+    if(p) {
+        QByteArray data = QByteArray::fromRawData(reinterpret_cast<const char*>(p), b.length);
+        QDataStream in(data);
+        in >> b.rows;
+        spillFile->unmap(p);
+    } else {
+        // mapping can fail (e.g. address space exhaustion on 32-bit), fall back to a plain read
+        spillFile->seek(b.offset);
+        QDataStream in(spillFile->read(b.length));
+        in >> b.rows;
+    }
+    b.resident = true;
+    residentBytes += b.bytes;
+}
+
+void RowStore::spill(Block& b) const {
+    if(b.offset == -1) {
+        if(!spillFile) {
+            spillFile = new QTemporaryFile(QDir::tempPath() + "/sequeljoe-rows");
+            if(!spillFile->open()) {
+                delete spillFile;
+                spillFile = nullptr;
+                return;
+            }
+        }
+        QByteArray data;
+        {
+            QDataStream out(&data, QIODevice::WriteOnly);
+            out << b.rows;
+        }
+        b.offset = spillFile->size();
+        spillFile->seek(b.offset);
+        if(spillFile->write(data) != data.size()) {
+            // keep the block in memory rather than lose it
+            b.offset = -1;
+            return;
+        }
+        spillFile->flush();
+        b.length = data.size();
+    }
+    b.rows = ResultRows();
+    b.resident = false;
+    residentBytes -= b.bytes;
+}
+
+void RowStore::enforceBudget(const Block* keep) const {
+    while(residentBytes > budget) {
+        Block* victim = nullptr;
+        for(Block& b : blocks) {
+            if(b.resident && &b != keep && (!victim || b.lastUse < victim->lastUse))
+                victim = &b;
+        }
+        if(!victim)
+            return;
+        spill(*victim);
+        if(victim->resident) // could not be written out
+            return;
+    }
+}
+
+qint64 RowStore::estimateSize(const QVector<QVariant>& row) {
+    qint64 sz = sizeof(QVector<QVariant>) + row.count() * sizeof(QVariant);
+    for(const QVariant& v : row) {
+        switch(v.type()) {
+        case QVariant::String:
+            sz += v.toString().size() * sizeof(QChar);
+            break;
+        case QVariant::ByteArray:
+            sz += v.toByteArray().size();
+            break;
+        default:
+            break;
+        }
+    }
+    return sz;
+}
@@ -0,0 +1,59 @@
+/*
+ * Copyright 2014 Oliver Giles
+ *
+ * This file is part of SequelJoe. SequelJoe is licensed under the
+ * GNU GPL version 3. See LICENSE or <http://www.gnu.org/licenses/>
+ * for more information
+ */
+#ifndef _SEQUELJOE_ROWSTORE_H_
+#define _SEQUELJOE_ROWSTORE_H_
+
+#include "tabledata.h"
+
+class QTemporaryFile;
+
+// Row storage for streamed results with a bounded memory footprint. Rows are
+// kept in fixed-size blocks; once the estimated size of the resident blocks
+// exceeds the budget, the least recently used blocks are serialised to a
+// temporary file and mapped back in when a row in them is next read.
+class RowStore {
+public:
+    explicit RowStore(qint64 memoryBudget = 64 << 20);
+    ~RowStore();
+
+    void setMemoryBudget(qint64 bytes);
+    qint64 memoryBudget() const { return budget; }
+
+    int count() const { return nRows; }
+    void append(const ResultRows& rows);
+    void clear();
+
+    QVariant value(int row, int col) const;
+
+private:
+    enum { BLOCK_ROWS = 1024 };
+
+    struct Block {
+        ResultRows rows; // empty while spilled
+        qint64 bytes = 0; // estimated size when resident
+        qint64 offset = -1; // position in the spill file, -1 if not written
+        qint64 length = 0;
+        bool resident = true;
+        quint64 lastUse = 0;
+    };
+
+    Block& block(int row) const;
+    void pageIn(Block& b) const;
+    void spill(Block& b) const;
+    void enforceBudget(const Block* keep) const;
+    static qint64 estimateSize(const QVector<QVariant>& row);
+
+    qint64 budget;
+    int nRows;
+    mutable QVector<Block> blocks;
+    mutable qint64 residentBytes;
+    mutable quint64 useClock;
+    mutable QTemporaryFile* spillFile;
+};
+
+#endif // _SEQUELJOE_ROWSTORE_H_
@@ -4,6 +4,11 @@
 struct SavedConfig {
     static constexpr int DEFAULT_SQL_PORT = 3306;
     static constexpr int DEFAULT_SSH_PORT = 22;
+    static constexpr int DEFAULT_SSH_WINDOW_SIZE = 4 << 20;
+    static constexpr int DEFAULT_SSH_PACKET_SIZE = 32768;
+    static constexpr int DEFAULT_SSH_CONNECT_TIMEOUT = 10000;
+    static constexpr int DEFAULT_RESULT_MEMORY_BUDGET = 64 << 20;
+    static constexpr int DEFAULT_LOADING_OVERLAY_DELAY = 300;
 
 
 
@@ -20,6 +25,15 @@ struct SavedConfig {
     static constexpr const char* KEY_SSH_USER = "SshUser";
     static constexpr const char* KEY_SSH_PASS = "SshPass";
     static constexpr const char* KEY_SSH_KEY = "SshKeyPath";
+    static constexpr const char* KEY_SSH_COMPRESS = "SshCompress";
+    static constexpr const char* KEY_SSH_WINDOW_SIZE = "SshWindowSize";
+    static constexpr const char* KEY_SSH_PACKET_SIZE = "SshPacketSize";
+    static constexpr const char* KEY_SSH_UNIX_SOCKET = "SshUnixSocket";
+    static constexpr const char* KEY_SSH_CONNECT_TIMEOUT = "SshConnectTimeout";
+
+    // application-wide, not per connection
+    static constexpr const char* KEY_RESULT_MEMORY_BUDGET = "ResultMemoryBudget";
+    static constexpr const char* KEY_LOADING_OVERLAY_DELAY = "LoadingOverlayDelay"; // ms
 
 };
 
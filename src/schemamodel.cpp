@@ -86,7 +86,15 @@ SqlSchemaModel::SqlSchemaModel(DbConnection& db, QString tableName, QObject *par
 void SqlSchemaModel::select() {
     beginResetModel();
     constraintsProxy->beginReset();
-    QMetaObject::invokeMethod(&db, "queryTableColumns", Qt::QueuedConnection, Q_ARG(Schema*, &schema), Q_ARG(QString, tableName), Q_ARG(QObject*, this));
+    DbConnection* conn = &db;
+    QString table = tableName;
+    // filled in on the worker and handed over, the model may be gone by then
+    db.jobs().submit(JobQueue::VISIBLE_PAGE, "columns", [conn, table]{
+        return conn->queryTableColumns(table);
+    }).then(this, [this](Schema result){
+        schema = result;
+        selectComplete(0);
+    });
 }
 
 void SqlSchemaModel::selectComplete(int nRows) {
@@ -143,7 +151,7 @@ QString SqlSchemaModel::schemaQuery(const std::array<QVariant,SCHEMA_NUM_FIELDS>
 //    ForeignKey fk = def[SCHEMA_FOREIGNKEY].value<ForeignKey>();
 //    if(!fk.column.isNull() || !fk.constraint.isNull()) {
 //        if(!fk.constraint.isNull())
-//            QMetaObject::invokeMethod(&db, "queryTableUpdate", Q_ARG(QString, "ALTER TABLE " + tableName + " DROP FOREIGN KEY \"" + fk.constraint + "\""), Q_ARG(QObject*, this));
+//            queueUpdate("ALTER TABLE " + tableName + " DROP FOREIGN KEY \"" + fk.constraint + "\"");
 
 //        fk.constraint = "FK_" + tableName.toUpper() + "_" + def[SCHEMA_NAME].toString().toUpper() + "_" + fk.table.toUpper() + "_" + fk.column.toUpper();
 //        setData(index(updatingRow, SCHEMA_FOREIGNKEY), QVariant::fromValue<ForeignKey>(fk), Qt::EditRole);
@@ -173,11 +181,11 @@ void SqlSchemaModel::saveConstraint(Constraint c) {
     } else if(c.detail.type == ConstraintDetail::CONSTRAINT_UNIQUE) {
         // todo
     }
-    QMetaObject::invokeMethod(&db, "queryTableUpdate", Q_ARG(QString, q), Q_ARG(QObject*, this));
+    queueUpdate(q);
 }
 
 void SqlSchemaModel::removeConstraint(Constraint c) {
-    QMetaObject::invokeMethod(&db, "queryTableUpdate", Q_ARG(QString, "ALTER TABLE \"" + tableName + "\" DROP FOREIGN KEY \"" + c.name + "\""), Q_ARG(QObject*, this));
+    queueUpdate("ALTER TABLE \"" + tableName + "\" DROP FOREIGN KEY \"" + c.name + "\"");
 }
 
 
@@ -198,7 +206,7 @@ bool SqlSchemaModel::submit() {
                 newColumn[it.key()] = it.value();
 
             QString updateQuery = "ALTER TABLE \"" + tableName + "\" ADD COLUMN " + schemaQuery(newColumn);
-            QMetaObject::invokeMethod(&db, "queryTableUpdate", Q_ARG(QString, updateQuery), Q_ARG(QObject*, this));
+            queueUpdate(updateQuery);
 
         } else {
             std::array<QVariant, SCHEMA_NUM_FIELDS> newColumn = schema.columns[updatingRow];
@@ -208,7 +216,7 @@ bool SqlSchemaModel::submit() {
             QString oldColumnName = originalColumnName.isEmpty() ? newColumn[SCHEMA_NAME].toString() : originalColumnName;
             QString updateQuery = QString("ALTER TABLE ") + "\"" + tableName + "\" CHANGE " + "\"" + oldColumnName + "\" " + schemaQuery(newColumn);
 
-            QMetaObject::invokeMethod(&db, "queryTableUpdate", Q_ARG(QString, updateQuery), Q_ARG(QObject*, this));
+            queueUpdate(updateQuery);
             originalColumnName.clear(); //< actually should probably be done after this was successful
         }
 
@@ -301,7 +309,7 @@ bool SqlSchemaModel::deleteRows(QSet<int> rows) {
     beginResetModel();
     for(int i : rows) {
         QString query("ALTER TABLE \"" + tableName + "\" DROP COLUMN \"" + schema.columns.at(i).at(SCHEMA_NAME).toString() + "\"");
-        QMetaObject::invokeMethod(&db, "queryTableUpdate", Q_ARG(QString, query), Q_ARG(QObject*, this));
+        queueUpdate(query);
         schema.columns.remove(i);
     }
     select(); // todo rowsremoved instead?
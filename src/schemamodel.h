@@ -52,6 +52,7 @@ public slots:
     void removeConstraint(Constraint c);
 protected slots:
     bool submit() override;
+protected:
     virtual void selectComplete(int nRows) override;
 
 private:
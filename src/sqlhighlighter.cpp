@@ -6,142 +6,215 @@
  * for more information
  */
 #include "sqlhighlighter.h"
+#include "sqllexer.h"
 #include <QTextDocument>
+#include <algorithm>
+#include <initializer_list>
+#include <string.h>
 #define SQL_KEYWORDS {"ABORT","ACTION","ADD","AFTER","ALL","ALTER","ANALYZE","AND","AS","ASC","ATTACH","AUTO_INCREMENT","AUTOINCREMENT","BEFORE","BEGIN","BETWEEN","BY","CASCADE","CASE","CAST","CHECK","COLLATE","COLUMN","COMMIT","CONFLICT","CONSTRAINT","CREATE","CROSS","CURRENT_DATE","CURRENT_TIME","CURRENT_TIMESTAMP","DATABASE","DEFAULT","DEFERRABLE","DEFERRED","DELETE","DESC","DETACH","DISTINCT","DROP","EACH","ELSE","END","ESCAPE","EXCEPT","EXCLUSIVE","EXISTS","EXPLAIN","FAIL","FOR","FOREIGN","FROM","FULL","GLOB","GROUP","HAVING","IF","IGNORE","IMMEDIATE","IN","INDEX","INDEXED","INITIALLY","INNER","INSERT","INSTEAD","INTERSECT","INTO","IS","ISNULL","JOIN","KEY","LEFT","LIKE","LIMIT","MATCH","NATURAL","NO","NOT","NOTNULL","NULL","OF","OFFSET","ON","OR","ORDER","OUTER","PLAN","PRAGMA","PRIMARY","QUERY","RAISE","RECURSIVE","REFERENCES","REGEXP","REINDEX","RELEASE","RENAME","REPLACE","RESTRICT","RIGHT","ROLLBACK","ROW","SAVEPOINT","SELECT","SET","TABLE","TEMP","TEMPORARY","THEN","TO","TRANSACTION","TRIGGER","UNION","UNIQUE","UPDATE","USING","VACUUM","VALUES","VIEW","VIRTUAL","WHEN","WHERE","WITH","WITHOUT"}
 #define SQL_TYPES {"TINYINT","SMALLINT","MEDIUMINT","INT","INTEGER","BIGINT","FLOAT","DOUBLE","DOUBLE PRECISION","REAL","DECIMAL","NUMERIC","DATE","DATETIME","TIMESTAMP","TIME","YEAR","CHAR","VARCHAR","TINYBLOB","TINYTEXT","BLOB","TEXT","MEDIUMBLOB","MEDIUMTEXT","LONGBLOB","LONGTEXT","ENUM","SET","UNSIGNED"}
 #define SQL_FUNCS {"ABS","ACOS","ADDDATE","ADDTIME","AES_DECRYPT","AES_ENCRYPT","AND","Area","AsBinary","AsWKB","ASCII","ASIN","AsText","AsWKT","ATAN2","ATAN","ATAN","AVG","BENCHMARK","BETWEEN","BIN","BINARY","BIT_AND","BIT_COUNT","BIT_LENGTH","BIT_OR","BIT_XOR","CASE","CAST","CEIL","CEILING","Centroid","CHAR_LENGTH","CHAR","CHARACTER_LENGTH","CHARSET","COALESCE","COERCIBILITY","COLLATION","COMPRESS","CONCAT_WS","CONCAT","CONNECTION_ID","Contains","CONV","CONVERT_TZ","CONVERT","COS","COT","COUNT","COUNT","CRC32","Crosses","CURDATE","CURRENT_DATE","CURRENT_DATE","CURRENT_TIME","CURRENT_TIME","CURRENT_TIMESTAMP","CURRENT_TIMESTAMP","CURRENT_USER","CURRENT_USER","CURTIME","DATABASE","DATE_ADD","DATE_FORMAT","DATE_SUB","DATE","DATEDIFF","DAY","DAYNAME","DAYOFMONTH","DAYOFWEEK","DAYOFYEAR","DECODE","DEFAULT","DEGREES","DES_DECRYPT","DES_ENCRYPT","Dimension","Disjoint","DIV","ELT","ENCODE","ENCRYPT","EndPoint","Envelope","Equals","EXP","EXPORT_SET","ExteriorRing","EXTRACT","FIELD","FIND_IN_SET","FLOOR","FORMAT","FOUND_ROWS","FROM_DAYS","FROM_UNIXTIME","GeomCollFromText","GeometryCollectionFromText","GeomCollFromWKB","GeometryCollectionFromWKB","GeometryCollection","GeometryN","GeometryType","GeomFromText","GeometryFromText","GeomFromWKB","GET_FORMAT","GET_LOCK","GLength","GREATEST","GROUP_CONCAT","HEX","HOUR","IF","IFNULL","IN","INET_ATON","INET_NTOA","INSERT","INSTR","InteriorRingN","Intersects","INTERVAL","IS_FREE_LOCK","IS NOT NULL","IS NOT","IS NULL","IS_USED_LOCK","IS","IsClosed","IsEmpty","ISNULL","IsSimple","LAST_DAY","LAST_INSERT_ID","LCASE","LEAST","LEFT","LENGTH","LIKE","LineFromText","LineFromWKB","LineStringFromWKB","LineString","LN","LOAD_FILE","LOCALTIME","LOCALTIME","LOCALTIMESTAMP","LOCALTIMESTAMP","LOCATE","LOG10","LOG2","LOG","LOWER","LPAD","LTRIM","MAKE_SET","MAKEDATE","MAKETIME","MASTER_POS_WAIT","MATCH","MAX","MBRContains","MBRDisjoint","MBREqual","MBRIntersects","MBROverlaps","MBRTouches","MBRWithin","MD5","MICROSECOND","MID","MIN","MINUTE","MLineFromText","MultiLineStringFromText","MLineFromWKB","MultiLineStringFromWKB","MOD","MONTH","MONTHNAME","MPointFromText","MultiPointFromText","MPointFromWKB","MultiPointFromWKB","MPolyFromText","MultiPolygonFromText","MPolyFromWKB","MultiPolygonFromWKB","MultiLineString","MultiPoint","MultiPolygon","NAME_CONST","NOW","NULLIF","NumGeometries","NumInteriorRings","NumPoints","OCT","OCTET_LENGTH","OLD_PASSWORD","OR","ORD","Overlaps","PASSWORD","PERIOD_ADD","PERIOD_DIFF","PI","Point","PointFromText","PointFromWKB","PointN","PolyFromText","PolygonFromText","PolyFromWKB","PolygonFromWKB","Polygon","POSITION","POW","POWER","PROCEDURE ANALYSE","QUARTER","QUOTE","RADIANS","RAND","REGEXP","RELEASE_LOCK","REPEAT","REPLACE","REVERSE","RIGHT","RLIKE","ROUND","ROW_COUNT","RPAD","RTRIM","SCHEMA","SEC_TO_TIME","SECOND","SESSION_USER","SHA1","SHA","SIGN","SIN","SLEEP","SOUNDEX","SOUNDS LIKE","SPACE","SQRT","SRID","StartPoint","STD","STDDEV_POP","STDDEV_SAMP","STDDEV","STR_TO_DATE","STRCMP","SUBDATE","SUBSTR","SUBSTRING_INDEX","SUBSTRING","SUBTIME","SUM","SYSDATE","SYSTEM_USER","TAN","TIME_FORMAT","TIME_TO_SEC","TIME","TIMEDIFF","TIMESTAMP","TIMESTAMPADD","TIMESTAMPDIFF","TO_DAYS","Touches","TRIM","TRUNCATE","UCASE","UNCOMPRESS","UNCOMPRESSED_LENGTH","UNHEX","UNIX_TIMESTAMP","UPPER","USER","UTC_DATE","UTC_TIME","UTC_TIMESTAMP","UUID","VALUES","VAR_POP","VAR_SAMP","VARIANCE","VERSION","WEEK","WEEKDAY","WEEKOFYEAR","Within","X","XOR","Y","YEAR","YEARWEEK"}
 
-SqlHighlighter::SqlHighlighter(QTextDocument *parent) : QSyntaxHighlighter(parent),
-    defaultFg(Qt::black)
-{
-    Rule r;
-    // keywords
-    r.fg = Qt::blue;
-    for(const char* keyword : SQL_KEYWORDS) {
-        r.pattern = QRegExp(QString("\\b") + keyword + "\\b", Qt::CaseInsensitive);
-        rules.append(r);
-    }
-    // types
-    r.fg = Qt::darkCyan;
-    for(const char* type : SQL_TYPES) {
-        r.pattern = QRegExp(QString("\\b") + type + "\\b", Qt::CaseInsensitive);
-        rules.append(r);
-    }
-    // functions
-    r.fg = Qt::red;
-    for(const char* type : SQL_FUNCS) {
-        r.pattern = QRegExp(QString("\\b") + type + "\\b", Qt::CaseInsensitive);
-        rules.append(r);
-    }
 
+namespace {
+
+enum {
+    CATEGORY_KEYWORD = 1,
+    CATEGORY_TYPE,
+    CATEGORY_FUNCTION
+};
+
+// longest word worth looking up. Anything longer can't be in the table
+const int MAX_WORD_LENGTH = 32;
+
+quint32 hashWord(quint32 seed, const char* s, int len) {
+    // FNV-1a, perturbed by the seed
+    quint32 h = 2166136261u ^ (seed * 0x9E3779B9u);
+    for(int i = 0; i < len; ++i) {
+        h ^= quint8(s[i]);
+        h *= 16777619u;
+    }
+    return h ^ (h >> 15);
 }
 
-void SqlHighlighter::highlightBlock(const QString &text) {
-    State pbs;
-    pbs.opaque = previousBlockState();
-    if(pbs.opaque == -1) {
-        pbs.opaque = 0;
-        pbs.s.col = -1;
+// Perfect hash over all keywords, types and functions (hash and displace):
+// the first hash picks a bucket, and each bucket stores the seed for a second
+// hash which sends every word in it to a distinct slot. A lookup is therefore
+// two hashes and at most one string compare, whatever the number of words.
+class KeywordTable {
+public:
+    KeywordTable() {
+        // later categories win, as the later regex rules used to
+        add(SQL_KEYWORDS, CATEGORY_KEYWORD);
+        add(SQL_TYPES, CATEGORY_TYPE);
+        add(SQL_FUNCS, CATEGORY_FUNCTION);
+
+        int n = words.count();
+        nSlots = 1;
+        while(nSlots < 2 * n)
+            nSlots <<= 1;
+        slots.fill(-1, nSlots);
+        displacement.fill(0, n / 4 + 1);
+
+        QVector<QVector<int>> buckets(displacement.count());
+        for(int i = 0; i < n; ++i)
+            buckets[bucket(words[i].constData(), words[i].length())].append(i);
+
+        QVector<int> order;
+        for(int b = 0; b < buckets.count(); ++b)
+            order.append(b);
+        // place the most crowded buckets first, while there is still room
+        std::sort(order.begin(), order.end(), [&](int a, int b) { return buckets[a].count() > buckets[b].count(); });
+
+        for(int b : order) {
+            const QVector<int>& keys = buckets[b];
+            for(quint32 d = 1; !keys.isEmpty(); ++d) {
+                QVector<int> taken;
+                for(int k : keys) {
+                    int s = slot(d, words[k].constData(), words[k].length());
+                    if(slots[s] != -1 || taken.contains(s))
+                        break;
+                    taken.append(s);
+                }
+                if(taken.count() == keys.count()) {
+                    for(int j = 0; j < keys.count(); ++j)
+                        slots[taken[j]] = keys[j];
+                    displacement[b] = d;
+                    break;
+                }
+            }
+        }
     }
 
-    if(text.length() == 0) {
-        setCurrentBlockState(pbs.opaque);
-        return;
+    // returns the category of the word, or 0
+    int lookup(const QChar* s, int len) const {
+        if(len > MAX_WORD_LENGTH)
+            return 0;
+        char upper[MAX_WORD_LENGTH];
+        for(int i = 0; i < len; ++i) {
+            ushort c = s[i].unicode();
+            if(c > 0x7f)
+                return 0;
+            upper[i] = (c >= 'a' && c <= 'z') ? char(c - 0x20) : char(c);
+        }
+        int k = slots[slot(displacement[bucket(upper, len)], upper, len)];
+        if(k == -1 || words[k].length() != len || memcmp(words[k].constData(), upper, len) != 0)
+            return 0;
+        return categories[k];
     }
 
-    auto bgColor = [](int i) -> QColor {
-        return QColor::fromHsv((75*i+20)%255,20,250);
-    };
+private:
+    void add(std::initializer_list<const char*> list, int category) {
+        for(const char* w : list) {
+            QByteArray word = QByteArray(w).toUpper();
+            // phrases such as "IS NOT NULL" are made up of words which
+            // are highlighted individually anyway
+            if(word.contains(' '))
+                continue;
+            int i = words.indexOf(word);
+            if(i == -1) {
+                words.append(word);
+                categories.append(category);
+            } else {
+                categories[i] = category;
+            }
+        }
+    }
 
-    State st = pbs;
+    int bucket(const char* s, int len) const {
+        return hashWord(0, s, len) % displacement.count();
+    }
 
-    QTextCharFormat f;
-    f.setBackground(bgColor(st.s.idx));
-    setFormat(0, currentBlock().length(), f);
+    int slot(quint32 seed, const char* s, int len) const {
+        return hashWord(seed, s, len) & (nSlots - 1);
+    }
 
-    int startIndex = 0;
-    int len = 0;
+    QVector<QByteArray> words;
+    QVector<int> categories;
+    QVector<quint32> displacement;
+    QVector<int> slots;
+    int nSlots;
+};
 
-    auto hlWords = [&](int from){
-        foreach (const Rule &rule, rules) {
-            QRegExp expression(rule.pattern);
-            int index = expression.indexIn(text, from);
-            while(index >= 0) {
-                int length = expression.matchedLength();
-                f.setForeground(rule.fg);
+const KeywordTable& keywordTable() {
+    static KeywordTable table;
+    return table;
+}
 
-                setFormat(index, length, f);
-                index = expression.indexIn(text, index + length);
-            };
-        }
-    };
+}
 
-    auto findBegin = [&](){
-        int s = QRegExp("(?:/\\*|[\"']|--|;)").indexIn(text, startIndex+len);
-        if(s >=0) {
-            QChar c = text.at(s);
-            if(c == '/' || c == '-')
-                st.s.mode = STATE_COMMENT;
-            else if(c == '\'')
-                st.s.mode = STATE_SNGSTR;
-            else if(c == '"')
-                st.s.mode = STATE_DBLSTR;
-            else { // end of statement
-                st.s.idx++;
-                st.s.col = s;
-                hlWords(startIndex + len);
-                f.setForeground(defaultFg);
-                f.setBackground(bgColor(st.s.idx));
-                setFormat(s+1,currentBlock().length() - s-1, f);
-                hlWords(s);
-            }
-        }
-        return s;
+SqlHighlighter::SqlHighlighter(QTextDocument *parent) :
+    QSyntaxHighlighter(parent),
+    hashComments(false)
+{
+    auto bgColor = [](int i) -> QColor {
+        return QColor::fromHsv((75*i+20)%255,20,250);
     };
+    const QColor fg[NUM_STYLES] = { Qt::black, Qt::blue, Qt::darkCyan, Qt::red, Qt::darkGreen, Qt::gray };
 
-    setCurrentBlockState(st.opaque);
-    hlWords(0);
-
-    if(!(pbs.opaque&(STATE_COMMENT|STATE_DBLSTR|STATE_SNGSTR))) {
-        startIndex = findBegin();
+    for(int parity = 0; parity < 2; ++parity) {
+        for(int style = 0; style < NUM_STYLES; ++style) {
+            formats[parity][style].setBackground(bgColor(parity));
+            formats[parity][style].setForeground(fg[style]);
+        }
     }
+    // build the table now rather than on the first keystroke
+    keywordTable();
+}
 
-    while(startIndex >= 0) {
-        // special case for strings
-        char md = st.s.mode;
-        if(startIndex == 0 && (((pbs.opaque&STATE_DBLSTR) && text.at(0) == '"') ||
-                ((pbs.opaque&STATE_SNGSTR) && text.at(0) == '\''))) {
-            len = 1;
-            st.s.mode = STATE_NONE;
-        } else if(text.at(startIndex) == '-') {
-            len = currentBlock().length() - startIndex;
-            st.s.mode = STATE_NONE;
-        } else if(st.s.mode == STATE_NONE) {
-            len = 1;
-            }else{
-            int end = st.s.mode == STATE_COMMENT ?
-                        QRegExp("\\*/").indexIn(text, startIndex) :
-                        st.s.mode == STATE_DBLSTR ?
-                        QRegExp("[^\\\\]\"").indexIn(text, startIndex) :
-                        QRegExp("[^\\\\]'").indexIn(text, startIndex);
-
-            if(end == -1) {
-
-                len = currentBlock().length() - startIndex;
-            } else {
-                // len(*/)==len([^\\]['"])==2
-                len = end + 2 - startIndex;
-                st.s.mode = STATE_NONE;
+void SqlHighlighter::setHashComments(bool enable) {
+    if(enable == hashComments)
+        return;
+    hashComments = enable;
+    rehighlight();
+}
+
+void SqlHighlighter::highlightBlock(const QString &text) {
+    int state = previousBlockState();
+    if(state == -1)
+        state = SqlLexer::STATE_NONE;
+
+    int parity = (state & STATE_ODD_STATEMENT) ? 1 : 0;
+    const int n = text.length();
+    const KeywordTable& keywords = keywordTable();
+
+    // background for the statement the block starts in. Tokens and
+    // statement ends below paint over it
+    setFormat(0, n, formats[parity][STYLE_DEFAULT]);
+
+    SqlLexer lexer(text, SqlLexer::State(state & STATE_MODE_MASK), hashComments);
+    SqlLexer::Token t;
+    while(lexer.next(&t)) {
+        switch(t.type) {
+        case SqlLexer::TOKEN_COMMENT:
+            setFormat(t.from, t.length, formats[parity][STYLE_COMMENT]);
+            break;
+        case SqlLexer::TOKEN_STRING:
+            setFormat(t.from, t.length, formats[parity][STYLE_STRING]);
+            break;
+        case SqlLexer::TOKEN_SEMICOLON:
+            parity ^= 1;
+            setFormat(t.from + 1, n - t.from - 1, formats[parity][STYLE_DEFAULT]);
+            break;
+        case SqlLexer::TOKEN_WORD:
+            switch(keywords.lookup(text.constData() + t.from, t.length)) {
+            case CATEGORY_KEYWORD:
+                setFormat(t.from, t.length, formats[parity][STYLE_KEYWORD]);
+                break;
+            case CATEGORY_TYPE:
+                setFormat(t.from, t.length, formats[parity][STYLE_TYPE]);
+                break;
+            case CATEGORY_FUNCTION:
+                setFormat(t.from, t.length, formats[parity][STYLE_FUNCTION]);
+                break;
+            default:
+                break;
             }
+            break;
+        default:
+            break;
         }
-        if((md & STATE_COMMENT))
-            f.setForeground(Qt::gray);
-        else if(md & (STATE_DBLSTR|STATE_SNGSTR))
-            f.setForeground(Qt::darkGreen);
-        setFormat(startIndex, len, f);
-        startIndex = findBegin();
     }
-    setCurrentBlockState(st.opaque);
 
+    setCurrentBlockState(lexer.state() | (parity ? STATE_ODD_STATEMENT : 0));
 }
-
@@ -15,34 +15,36 @@ class SqlHighlighter : public QSyntaxHighlighter {
 public:
     explicit SqlHighlighter(QTextDocument* parent);
 
-    enum {
-        STATE_NONE      = 0x00,
-        STATE_DBLSTR    = 0x01,
-        STATE_SNGSTR    = 0x02,
-        STATE_COMMENT   = 0x04,
-        STATE_CURRENT   = 0x08
-    };
+    // whether # starts a comment, see SqlLexer
+    void setHashComments(bool enable);
 
-    union State {
-        struct {
-            char mode;
-            char idx;
-            char col;
-        } s;
-        int opaque;
+    // The block state holds only what the lexer needs to resume at the start of
+    // the next block. QSyntaxHighlighter stops rehighlighting following blocks
+    // as soon as an edit leaves a block's state unchanged
+    enum {
+        // a SqlLexer::State
+        STATE_MODE_MASK     = 0x03,
+        // statements are shaded alternately
+        STATE_ODD_STATEMENT = 0x04
     };
 
 protected:
     virtual void highlightBlock(const QString &text) override;
 
 private:
-
-    struct Rule {
-        QRegExp pattern;
-        QColor fg;
+    enum {
+        STYLE_DEFAULT = 0,
+        STYLE_KEYWORD,
+        STYLE_TYPE,
+        STYLE_FUNCTION,
+        STYLE_STRING,
+        STYLE_COMMENT,
+
+        NUM_STYLES
     };
-    QVector<Rule> rules;
-    QColor defaultFg;
+    // indexed by statement parity, then style
+    QTextCharFormat formats[2][NUM_STYLES];
+    bool hashComments;
 };
 
 #endif // _SEQUELJOE_SQLHIGHLIGHTER_H_
@@ -0,0 +1,99 @@
+/*
+ * Copyright 2014 Oliver Giles
+ *
+ * This file is part of SequelJoe. SequelJoe is licensed under the
+ * GNU GPL version 3. See LICENSE or <http://www.gnu.org/licenses/>
+ * for more information
+ */
+#include "sqllexer.h"
+
+namespace {
+
+inline bool isWordStart(QChar c) {
+    return c.isLetter() || c == '_';
+}
+
+inline bool isWordChar(QChar c) {
+    return c.isLetterOrNumber() || c == '_' || c == '$';
+}
+
+}
+
+SqlLexer::SqlLexer(const QString& text, State state, bool hashComments, int from) :
+    s(text.constData()),
+    n(text.length()),
+    i(from),
+    mode(state),
+    hashComments(hashComments)
+{
+}
+
+bool SqlLexer::next(Token* token) {
+    if(i >= n)
+        return false;
+    int start = i;
+    Type type = TOKEN_OTHER;
+
+    if(mode == STATE_COMMENT) {
+        scanComment();
+        type = TOKEN_COMMENT;
+    } else if(mode == STATE_SNGSTR || mode == STATE_DBLSTR) {
+        scanString();
+        type = TOKEN_STRING;
+    } else {
+        QChar c = s[i];
+        if((c == '-' && i + 1 < n && s[i+1] == '-') || (c == '#' && hashComments)) {
+            i = n;
+            type = TOKEN_COMMENT;
+        } else if(c == '/' && i + 1 < n && s[i+1] == '*') {
+            mode = STATE_COMMENT;
+            i += 2;
+            scanComment();
+            type = TOKEN_COMMENT;
+        } else if(c == '\'' || c == '"') {
+            mode = (c == '\'') ? STATE_SNGSTR : STATE_DBLSTR;
+            ++i;
+            scanString();
+            type = TOKEN_STRING;
+        } else if(c == ';') {
+            ++i;
+            type = TOKEN_SEMICOLON;
+        } else if(isWordStart(c)) {
+            while(i < n && isWordChar(s[i]))
+                ++i;
+            type = TOKEN_WORD;
+        } else if(c.isDigit()) {
+            // so that e.g. the 'e' in 1e10 isn't taken for a word
+            while(i < n && isWordChar(s[i]))
+                ++i;
+            type = TOKEN_NUMBER;
+        } else {
+            ++i;
+        }
+    }
+
+    token->type = type;
+    token->from = start;
+    token->length = i - start;
+    return true;
+}
+
+void SqlLexer::scanComment() {
+    while(i < n && !(s[i] == '*' && i + 1 < n && s[i+1] == '/'))
+        ++i;
+    if(i < n) {
+        i += 2;
+        mode = STATE_NONE;
+    }
+}
+
+void SqlLexer::scanString() {
+    QChar quote = (mode == STATE_SNGSTR) ? '\'' : '"';
+    while(i < n && s[i] != quote)
+        i += (s[i] == '\\') ? 2 : 1;
+    if(i < n) {
+        ++i;
+        mode = STATE_NONE;
+    }
+    i = qMin(i, n);
+}
@@ -0,0 +1,61 @@
+/*
+ * Copyright 2014 Oliver Giles
+ *
+ * This file is part of SequelJoe. SequelJoe is licensed under the
+ * GNU GPL version 3. See LICENSE or <http://www.gnu.org/licenses/>
+ * for more information
+ */
+#ifndef _SEQUELJOE_SQLLEXER_H_
+#define _SEQUELJOE_SQLLEXER_H_
+
+#include <QString>
+
+// Splits a line of SQL into tokens. Strings and block comments may carry on
+// over several lines, so a lexer starts in the state the previous line ended
+// in. Shared by SqlHighlighter and StatementIndex so that they agree on what
+// is a string, a comment and the end of a statement
+class SqlLexer {
+public:
+    // what a line ends inside of
+    enum State {
+        STATE_NONE = 0,
+        STATE_SNGSTR,
+        STATE_DBLSTR,
+        STATE_COMMENT
+    };
+
+    enum Type {
+        TOKEN_WORD,
+        TOKEN_NUMBER,
+        TOKEN_STRING,
+        TOKEN_COMMENT,
+        TOKEN_SEMICOLON,
+        TOKEN_OTHER
+    };
+
+    struct Token {
+        Type type;
+        int from;
+        int length;
+    };
+
+    // text must outlive the lexer. With hashComments, # starts a comment to
+    // the end of the line, as in MySQL
+    SqlLexer(const QString& text, State state, bool hashComments, int from = 0);
+
+    // false at the end of the line
+    bool next(Token* token);
+    State state() const { return mode; }
+
+private:
+    void scanComment();
+    void scanString();
+
+    const QChar* s;
+    int n;
+    int i;
+    State mode;
+    bool hashComments;
+};
+
+#endif // _SEQUELJOE_SQLLEXER_H_
@@ -7,26 +7,57 @@
  */
 #include "sqlmodel.h"
 #include "driver.h"
+#include "foreignkey.h"
+#include "trace.h"
 
 #include <QSqlDatabase>
 #include <QSqlQuery>
 #include <QSqlResult>
 #include <QStringList>
 #include <QSqlError>
-#include <QPushButton>
 #include <QSqlRecord>
 
 SqlModel::SqlModel(DbConnection &db, QObject *parent) :
     QAbstractItemModel(parent),
     db(db),
     dataSafe(false),
-    res(*db.sqlDriver()),
+    cursor(new Cursor(*db.sqlDriver())),
+    res(cursor->query),
     updatingRow(-1),
     numRows(0),
     totalRecords(-1),
     rowsFrom(0),
-    rowsLimit(0)
+    rowsLimit(0),
+    streaming(false),
+    streamFetching(false),
+    streamAtEnd(true),
+    selectPending(false),
+    selectInFlight(false),
+    selectQueued(false),
+    renderCache(RENDER_CACHE_ROWS)
 {
+    connect(this, &QAbstractItemModel::modelReset, [this]{ renderCache.clear(); });
+    connect(this, &QAbstractItemModel::layoutChanged, [this]{ renderCache.clear(); });
+    connect(this, &QAbstractItemModel::dataChanged, [this](const QModelIndex& tl, const QModelIndex& br){
+        invalidateRender(tl.row(), br.row());
+    });
+    // rows appended while streaming leave the cached rows where they are
+    connect(this, &QAbstractItemModel::rowsInserted, [this](const QModelIndex& parent, int first, int){
+        if(!parent.isValid())
+            truncateRender(first);
+    });
+    connect(this, &QAbstractItemModel::rowsRemoved, [this](const QModelIndex& parent, int first, int){
+        if(!parent.isValid())
+            truncateRender(first);
+    });
+}
+
+SqlModel::~SqlModel() {
+    if(streaming) {
+        DbConnection* conn = &db;
+        QString name = DbConnection::cursorName(&res);
+        db.jobs().post(JobQueue::BACKGROUND, "closeTableStream", [conn, name]{ conn->closeTableStream(name); });
+    }
 }
 
 int SqlModel::columnCount(const QModelIndex &parent) const {
@@ -36,7 +67,7 @@ int SqlModel::columnCount(const QModelIndex &parent) const {
     if(parent.isValid())
         return 1;
 
-    return res.record().count();
+    return fields.count();
 }
 
 bool SqlModel::columnIsBoolType(int col) const {
@@ -61,17 +92,6 @@ int SqlModel::rowCount(const QModelIndex &parent) const {
 
 QVariant SqlModel::data(const QModelIndex &index, int role) const {
 
-    if(role == HeightMultiple) {
-        if(dataSafe && index.column() < metadata.count()) {
-            QString type = metadata.columnTypes.at(index.column());
-            if(type.contains("text", Qt::CaseInsensitive))
-                return 4;
-            if(type.contains("varchar", Qt::CaseInsensitive))
-                return 2;
-        }
-        return 1;
-    }
-
     if(!dataSafe)
         return QVariant();
 
@@ -82,16 +102,16 @@ QVariant SqlModel::data(const QModelIndex &index, int role) const {
         if(role == Qt::CheckStateRole) {
             if(index.row() == updatingRow && !currentRowModifications[index.column()].isNull())
                 return currentRowModifications[index.column()].toBool() ? Qt::Checked : Qt::Unchecked;
-            if(index.row() < numRows && res.seek(index.row()))
-                return res.value(index.column()).toBool() ? Qt::Checked : Qt::Unchecked;
+            if(index.row() < numRows)
+                return value(index.row(), index.column()).toBool() ? Qt::Checked : Qt::Unchecked;
         }
     } else {
         if(index.isValid() && (role == Qt::DisplayRole || role == Qt::EditRole) && index.row() < rowCount() && index.column() < columnCount()) {
             QVariant d;
             if(index.row() == updatingRow && currentRowModifications.contains(index.column()))
                 d = currentRowModifications[index.column()];
-            else if(index.row() < numRows && res.seek(index.row()))
-                d = res.value(index.column());
+            else if(index.row() < numRows)
+                d = value(index.row(), index.column());
 
             if(role == Qt::EditRole)
                 return d;
@@ -105,6 +125,70 @@ QVariant SqlModel::data(const QModelIndex &index, int role) const {
     return QVariant();
 }
 
+QVariant SqlModel::value(int row, int col) const {
+    if(streaming)
+        return streamRows.value(row, col);
+    if(res.seek(row))
+        return res.value(col);
+    return QVariant();
+}
+
+const SqlModel::CellRender* SqlModel::renderRecord(const QModelIndex& index) const {
+    if(!dataSafe || !index.isValid() || index.parent().isValid() || index.model() != this)
+        return nullptr;
+    int row = index.row();
+    if(row >= rowCount())
+        return nullptr;
+    const QVector<CellRender>* cells = renderCache.object(row);
+    if(!cells)
+        cells = fillRenderRow(row);
+    return index.column() < cells->count() ? &cells->at(index.column()) : nullptr;
+}
+
+const QVector<SqlModel::CellRender>* SqlModel::fillRenderRow(int row) const {
+    int nColumns = columnCount();
+    QVector<CellRender>* cells = new QVector<CellRender>(nColumns);
+    QVariant expandedColumn = data(index(row, 0), ExpandedColumnIndexRole);
+    int expanded = expandedColumn.isValid() ? expandedColumn.toInt() : -1;
+    for(int c = 0; c < nColumns; ++c) {
+        QModelIndex idx = index(row, c);
+        CellRender& r = (*cells)[c];
+        r.display = data(idx, Qt::DisplayRole);
+        QVariant alignment = data(idx, Qt::TextAlignmentRole);
+        r.alignment = alignment.isValid() && !alignment.isNull() ? Qt::Alignment(alignment.toInt()) : Qt::Alignment();
+        QVariant check = data(idx, Qt::CheckStateRole);
+        r.checkState = check.isValid() ? check.toInt() : -1;
+        r.isNull = r.display.isNull() && !check.isValid();
+        r.foreignKey = !data(idx, ForeignKeyRole).value<ForeignKey>().isNull();
+        r.expanded = (expanded == c);
+        r.shades.clear();
+        for(const QVariant& shade : data(idx, Qt::TextColorRole).toList())
+            r.shades << shade.toDouble();
+    }
+    renderCache.insert(row, cells);
+    return cells;
+}
+
+void SqlModel::invalidateRender(int first, int last) const {
+    if(last < first)
+        last = first;
+    // a change to one row shouldn't walk the whole range of a big dataChanged
+    if(last - first < renderCache.count()) {
+        for(int i = qMax(first, 0); i <= last; ++i)
+            renderCache.remove(i);
+    } else {
+        for(int row : renderCache.keys())
+            if(row >= first && row <= last)
+                renderCache.remove(row);
+    }
+}
+
+void SqlModel::truncateRender(int first) const {
+    for(int row : renderCache.keys())
+        if(row >= first)
+            renderCache.remove(row);
+}
+
 bool SqlModel::insertRows(int row, int count, const QModelIndex &parent) {
     int rows = rowCount();
     beginInsertRows(parent, rows, rows+1);
@@ -147,11 +231,15 @@ QModelIndex SqlModel::parent(const QModelIndex &child) const {
 
 QVariant SqlModel::headerData(int section, Qt::Orientation orientation, int role) const {
     if(!dataSafe) return QVariant();
+    if(orientation == Qt::Horizontal && role == ColumnCharWidthRole)
+        return section < columnWidths.count() ? QVariant(columnWidths.at(section)) : QVariant();
+    if(orientation == Qt::Horizontal && role == ColumnTypeRole)
+        return section < metadata.count() ? QVariant(metadata.columnTypes.at(section)) : QVariant();
     if(orientation == Qt::Horizontal && role == Qt::DisplayRole) {
-        if(section < res.record().count()) {
+        if(section < fields.count()) {
             switch(role) {
             case Qt::DisplayRole:
-                return res.record().fieldName(section);
+                return fields.fieldName(section);
             case Qt::ToolTipRole: // move to tablemodel
                 return metadata.columnComments.at(section);
             }
@@ -161,17 +249,109 @@ QVariant SqlModel::headerData(int section, Qt::Orientation orientation, int role
 }
 
 void SqlModel::select() {
-    beginResetModel();
+    SJ_TRACE("SqlModel::select", "model");
+    cursor->generation.ref();
+    // one reset however many selects it takes to settle
+    if(!selectPending)
+        beginResetModel();
+    selectPending = true;
+
+    if(selectInFlight || streamFetching)
+        selectQueued = true;
+    else
+        issueSelect();
+}
 
+void SqlModel::issueSelect() {
+    selectInFlight = true;
+    selectQueued = false;
+    // the job gets the cursor rather than this, it mustn't touch the rest of
+    // the model from the worker thread
+    DbConnection* conn = &db;
+    QSharedPointer<Cursor> c = cursor;
+    int generation = c->generation.load();
     QString query = prepareQuery();
-    if(rowsLimit)
+
+    // without a row limit the result could be arbitrarily large. Rather than
+    // letting the driver materialise it, pull it through a cursor as the view
+    // scrolls (see fetchMore)
+    streaming = (rowsLimit == 0);
+    if(streaming) {
+        db.jobs().submit(JobQueue::VISIBLE_PAGE, "select", [=]{
+            return conn->queryTableStream(query, &c->query, STREAM_WINDOW, &c->sampledWidths, &c->record, &c->generation, generation);
+        }).then(this, [this](ResultRows rows){ streamComplete(rows); });
+        return;
+    }
+
     query += " LIMIT " + QString::number(rowsLimit) + " OFFSET " + QString::number(rowsFrom);
 
     res.prepare(query);
-    QMetaObject::invokeMethod(&db, "queryTableContent", Qt::QueuedConnection, Q_ARG(QSqlQuery*, &res), Q_ARG(QObject*, this));
+    db.jobs().submit(JobQueue::VISIBLE_PAGE, "select", [=]{
+        return conn->queryTableContent(&c->query, &c->sampledWidths, &c->generation, generation);
+    }).then(this, [this](int nRows){ selectComplete(nRows); });
+}
+
+void SqlModel::streamComplete(const ResultRows& rows) {
+    SJ_TRACE("SqlModel::streamComplete", "model");
+    // a query skipped as superseded always has a newer select() waiting
+    if(selectQueued)
+        return selectComplete(DbConnection::SUPERSEDED);
+    streamRows.clear();
+    streamRows.append(rows);
+    streamAtEnd = streamRows.count() < STREAM_WINDOW;
+    streamFetching = false;
+    totalRecords = streamAtEnd ? streamRows.count() : -1;
+    selectComplete(streamRows.count());
+}
+
+bool SqlModel::canFetchMore(const QModelIndex &parent) const {
+    return !parent.isValid() && streaming && dataSafe && !selectPending && !streamAtEnd;
+}
+
+void SqlModel::fetchMore(const QModelIndex &parent) {
+    if(streamFetching || !canFetchMore(parent))
+        return;
+    streamFetching = true;
+    DbConnection* conn = &db;
+    QSharedPointer<Cursor> c = cursor;
+    int generation = c->generation.load();
+    // the view asks for more once it is scrolled to the end, so the user is
+    // waiting to see these
+    db.jobs().submit(JobQueue::VISIBLE_PAGE, "fetchMore", [=]{
+        return conn->fetchTableStream(&c->query, STREAM_WINDOW, &c->generation, generation);
+    }).then(this, [this](ResultRows rows){ fetchComplete(rows); });
+}
+
+void SqlModel::fetchComplete(const ResultRows& rows) {
+    SJ_TRACE("SqlModel::fetchComplete", "model");
+    streamFetching = false;
+    // a select() was made after this fetch, so these rows are stale
+    if(selectPending) {
+        if(selectQueued)
+            issueSelect();
+        return;
+    }
+    streamAtEnd = rows.count() < STREAM_WINDOW;
+    if(!rows.isEmpty()) {
+        beginInsertRows(QModelIndex(), numRows, numRows + rows.count() - 1);
+        streamRows.append(rows);
+        numRows = streamRows.count();
+        endInsertRows();
+    }
+    if(streamAtEnd)
+        totalRecords = numRows;
+    signalPagination();
 }
 
 void SqlModel::selectComplete(int nRows) {
+    TraceSpan span("SqlModel::selectComplete", "model");
+    span.setArg("rows", nRows);
+    selectInFlight = false;
+    // a newer select() is waiting, so this result is already out of date
+    if(selectQueued) {
+        issueSelect();
+        return;
+    }
     if(nRows == 0 && rowsFrom > 0) {
         // we "found" the end of the table by paging forward. Back up.
         totalRecords = rowsFrom;
@@ -182,6 +362,9 @@ void SqlModel::selectComplete(int nRows) {
         totalRecords = rowsFrom + nRows;
     }
     numRows = nRows;
+    fields = streaming ? cursor->record : res.record();
+    columnWidths = cursor->sampledWidths;
+    selectPending = false;
     dataSafe = true;
     emit selectFinished();
     signalPagination();
@@ -218,6 +401,7 @@ Qt::ItemFlags SqlModel::flags(const QModelIndex &index) const {
 }
 
 bool SqlModel::setData(const QModelIndex &index, const QVariant &value, int role) {
+    invalidateRender(index.row());
     if(role == ExpandedColumnIndexRole) {
         if(value.toInt() == -1)
             expandedColumns.remove(index.row());
@@ -277,6 +461,13 @@ void SqlModel::deleteComplete(int rowsAffected, int) {
         select();
 }
 
+void SqlModel::queueUpdate(QString query, void (SqlModel::*complete)(int, int)) {
+    DbConnection* conn = &db;
+    db.jobs().submit(JobQueue::INTERACTIVE, "update", [conn, query]{
+        return conn->queryTableUpdate(query);
+    }).then(this, [this, complete](UpdateResult r){ (this->*complete)(r.rowsAffected, r.insertId); });
+}
+
 bool SqlModel::event(QEvent * e) {
     if(e->type() == QEvent::Type(RefreshEvent))
         return select(), true;
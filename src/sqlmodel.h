@@ -11,12 +11,17 @@
 #include "tabledata.h"
 #include "dbconnection.h"
 #include "roles.h"
+#include "rowstore.h"
 
 #include <QAbstractTableModel>
 #include <QVector>
 #include <QEvent>
+#include <QAtomicInt>
+#include <QCache>
 #include <QSet>
+#include <QSharedPointer>
 #include <QSqlQuery>
+#include <QSqlRecord>
 
 class DbConnection;
 
@@ -31,7 +36,7 @@ class SqlModel : public QAbstractItemModel {
     Q_OBJECT
 public:
     explicit SqlModel(DbConnection &db, QObject *parent = 0);
-    virtual ~SqlModel() {}
+    virtual ~SqlModel();
 
     int rowsPerPage() const { return rowsLimit; }
     void signalPagination() const { emit pagesChanged(rowsFrom, rowCount(), totalRecords); }
@@ -48,12 +53,30 @@ public:
     virtual QModelIndex index(int row, int column, const QModelIndex &parent = QModelIndex{}) const override;
     virtual QModelIndex parent(const QModelIndex &child = QModelIndex{}) const override;
     virtual bool hasChildren(const QModelIndex &parent) const override;
+    virtual bool canFetchMore(const QModelIndex &parent) const override;
+    virtual void fetchMore(const QModelIndex &parent) override;
 
     bool insertRows(int row, int count, const QModelIndex &parent) override;
     // hack to fetch for ForeignKeyEditor
     DbConnection* driver() const { return &db; }
 
     void setRowsPerPage(int r, bool refresh = true) { rowsLimit = r; if(refresh) select(); }
+    // bytes of streamed rows to keep in memory before spilling to disk
+    void setMemoryBudget(qint64 bytes) { streamRows.setMemoryBudget(bytes); }
+
+    // everything TableCell needs to paint a cell, gathered from data() once
+    // per row and kept until the row changes or scrolls well out of view
+    struct CellRender {
+        QVariant display;
+        QVector<qreal> shades; // hues in [0,1) from Qt::TextColorRole
+        Qt::Alignment alignment; // 0 without Qt::TextAlignmentRole
+        qint8 checkState; // -1 if the cell has no check indicator
+        bool isNull;
+        bool foreignKey;
+        bool expanded;
+    };
+    // valid until the next call, which may evict the row
+    const CellRender* renderRecord(const QModelIndex& index) const;
 signals:
     void pagesChanged(int,int,int) const;
     void selectFinished();
@@ -64,23 +87,52 @@ public slots:
     void prevPage();
     void lastPage();
 
-protected slots:
+protected:
     virtual void selectComplete(int nRows);
+    void streamComplete(const ResultRows& rows);
+    void fetchComplete(const ResultRows& rows);
     void updateComplete(int rowsAffected, int insertId);
     void deleteComplete(int rowsAffected, int);
-protected:
+    // runs an INSERT, UPDATE, DELETE or ALTER, then calls complete with the
+    // rows affected and the id of an inserted row
+    void queueUpdate(QString query, void (SqlModel::*complete)(int, int) = &SqlModel::updateComplete);
+
+
     virtual bool event(QEvent *) override;
     virtual QString prepareQuery() const { return query; }
     virtual bool columnIsBoolType(int col) const;
+    QVariant value(int row, int col) const;
+    void invalidateRender(int first, int last = -1) const;
 
 protected:
+    // number of rows pulled from the server at a time when streaming
+    enum { STREAM_WINDOW = 256 };
+
     bool isAdding() const { return (updatingRow != -1); }
 
+    // what select and fetch jobs work on. Held jointly with them, so that it
+    // outlives the model if one is still running when the model is deleted
+    struct Cursor {
+        explicit Cursor(const QSqlDatabase& db) : query(db), generation(0) {}
+        QSqlQuery query;
+        // see columnWidths
+        QVector<int> sampledWidths;
+        // the columns of a streamed result, which needn't come through query
+        QSqlRecord record;
+        // see issueSelect
+        QAtomicInt generation;
+    };
+
     DbConnection& db;
     QString query;
 
     bool dataSafe;
-    mutable QSqlQuery res;
+    QSharedPointer<Cursor> cursor;
+    QSqlQuery& res;
+    QSqlRecord fields;
+    // estimated width in characters of each column, see ColumnCharWidthRole.
+    // Filled in by the worker thread, then copied over on completion
+    QVector<int> columnWidths;
     TableMetadata metadata;
     QHash<int, int> expandedColumns;
 
@@ -91,6 +143,33 @@ protected:
     unsigned int totalRecords;
     int rowsFrom;
     unsigned int rowsLimit;
+
+    // unpaged results (rowsLimit == 0) are read through a server-side cursor
+    bool streaming;
+    bool streamFetching;
+    bool streamAtEnd;
+    bool selectPending;
+    RowStore streamRows;
+
+private:
+    const QVector<CellRender>* fillRenderRow(int row) const;
+    // sends the latest select() to the worker
+    void issueSelect();
+
+    // Only one select or fetch is with the worker at a time, since both use
+    // res. A select() made meanwhile waits, replacing any other waiting, and
+    // the results of the one with the worker are dropped. The worker skips
+    // or stops early on a request older than cursor->generation
+    bool selectInFlight;
+    bool selectQueued;
+
+    // rows painted recently, least recently used dropped first. Enough for
+    // a tall window with room to scroll back, without keeping every row of
+    // a long streamed result
+    enum { RENDER_CACHE_ROWS = 512 };
+    mutable QCache<int, QVector<CellRender>> renderCache;
+    // drops the cached rows from first on
+    void truncateRender(int first) const;
 };
 
 #endif // _SEQUELJOE_SQLMODEL_H_
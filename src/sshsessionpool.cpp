@@ -0,0 +1,89 @@
+/*
+ * Copyright 2014 Oliver Giles
+ *
+ * This file is part of SequelJoe. SequelJoe is licensed under the
+ * GNU GPL version 3. See LICENSE or <http://www.gnu.org/licenses/>
+ * for more information
+ */
+#include "sshsessionpool.h"
+
+#include "dbconnection.h"
+#include "sshthread.h"
+
+#include <QCryptographicHash>
+#include <QMutexLocker>
+#include <QThread>
+
+SshSessionPool& SshSessionPool::instance() {
+    static SshSessionPool pool;
+    return pool;
+}
+
+QString SshSessionPool::key(const SshParams& params) {
+    // a different password or key may well be a different account
+    QByteArray secret = params.useSshKey ? params.sshKeyPath : params.sshPass;
+    return params.sshUser + '@' + params.sshHost + ':' + params.sshPort +
+            (params.useSshKey ? "/publickey/" : "/password/") +
+            QCryptographicHash::hash(secret, QCryptographicHash::Sha1).toHex() +
+            // settled when the session connects, so can't be shared either
+            (params.compress ? "/compress/" : "/") + QString::number(params.connectTimeout);
+}
+
+SshTunnel* SshSessionPool::acquire(const SshParams& params, TunnelStats& stats) {
+    QMutexLocker locker(&lock);
+    QString k = key(params);
+
+    for(Session& s : sessions) {
+        if(s.key != k)
+            continue;
+        if(!s.ssh->isFinished()) {
+            s.users++;
+            return new SshTunnel(params, stats, s.ssh);
+        }
+        // it failed for good and its users are being told so. It goes away
+        // once they have all released their tunnels
+        s.key.clear();
+    }
+
+    Session s;
+    s.key = k;
+    s.ssh = new SshThread(params);
+    s.thread = new QThread;
+    s.thread->setObjectName("SSH " + params.sshHost);
+    s.users = 1;
+    s.ssh->moveToThread(s.thread);
+    QObject::connect(s.thread, SIGNAL(started()), s.ssh, SLOT(connectToServer()));
+    s.thread->start();
+    sessions.append(s);
+    return new SshTunnel(params, stats, s.ssh);
+}
+
+void SshSessionPool::release(SshTunnel* tunnel) {
+    // both this and shutdown wait for the SSH thread, which must not hold up
+    // other connections acquiring tunnels. The session can't go away before
+    // our user is counted off below
+    SshThread* ssh = tunnel->session;
+    ssh->removeTunnel(tunnel);
+    delete tunnel;
+
+    Session last = Session();
+    {
+        QMutexLocker locker(&lock);
+        for(int i = 0; i < sessions.count(); ++i) {
+            if(sessions.at(i).ssh == ssh && --sessions[i].users == 0) {
+                last = sessions.takeAt(i);
+                break;
+            }
+        }
+    }
+    if(last.ssh)
+        shutdown(last);
+}
+
+void SshSessionPool::shutdown(const Session& s) {
+    s.ssh->stop();
+    s.thread->exit();
+    s.thread->wait();
+    delete s.thread;
+    delete s.ssh;
+}
@@ -0,0 +1,55 @@
+/*
+ * Copyright 2014 Oliver Giles
+ *
+ * This file is part of SequelJoe. SequelJoe is licensed under the
+ * GNU GPL version 3. See LICENSE or <http://www.gnu.org/licenses/>
+ * for more information
+ */
+#ifndef _SEQUELJOE_SSHSESSIONPOOL_H_
+#define _SEQUELJOE_SSHSESSIONPOOL_H_
+
+#include <QList>
+#include <QMutex>
+#include <QString>
+
+class SshParams;
+class SshThread;
+class SshTunnel;
+class QThread;
+struct TunnelStats;
+
+// Process-wide registry of SSH sessions, keyed by server, user and
+// authentication method. Connections to databases behind the same server
+// share one authenticated session and only open a channel each, so only
+// the first pays for the handshake. A session is closed once its last
+// tunnel is released
+class SshSessionPool {
+public:
+    static SshSessionPool& instance();
+
+    // a tunnel to params.remoteHost over the matching session, connecting
+    // it first if there is none yet. params and stats must outlive it.
+    // Call SshTunnel::open once its signals are connected
+    SshTunnel* acquire(const SshParams& params, TunnelStats& stats);
+    // closes and deletes the tunnel. An unanswered confirmUnknownHost
+    // is taken as a no
+    void release(SshTunnel* tunnel);
+
+private:
+    SshSessionPool() {}
+
+    struct Session {
+        QString key;
+        SshThread* ssh;
+        QThread* thread;
+        int users;
+    };
+
+    static QString key(const SshParams& params);
+    static void shutdown(const Session& s);
+
+    QMutex lock;
+    QList<Session> sessions;
+};
+
+#endif // _SEQUELJOE_SSHSESSIONPOOL_H_
@@ -9,8 +9,11 @@
 #include <winsock2.h>
 #include <windows.h>
 #include <ws2tcpip.h>
+#define poll WSAPoll
 #else
 #include <sys/socket.h>
+#include <sys/un.h>
+#include <poll.h>
 #include <netdb.h>
 #include <netinet/in.h>
 #include <arpa/inet.h>
@@ -39,12 +42,18 @@
 #include <QByteArray>
 #include <QException>
 #include <QFileInfo>
-#include <QApplication>
+#include <QCoreApplication>
 #include <QStandardPaths>
 #include <QDir>
+#include <QVector>
+#include <QElapsedTimer>
+#include <QMutexLocker>
 
 #include "dbconnection.h"
 #include "sshthread.h"
+#include "connectionstats.h"
+#include "netutil.h"
+#include "trace.h"
 
 enum {
     AUTH_NONE = 0,
@@ -54,18 +63,13 @@ enum {
 
 int SshThread::nLibSshUsers = 0;
 
-// this variable is the local port number to bind to the forwarding connection.
-// the default is set to the typical upper bound of the ephemeral port range
-// to minimise conflicts. It will be incremented for each invocation of the class
-// (so you might run into problems if you create > 3535 connections without restarting)
-int SshThread::localBoundPort = 62000;
-
-SshThread::SshThread(SshParams &params) :
+SshThread::SshThread(const SshParams &params) :
     params(params)
 {
     sock = -1;
-    sockListen = -1;
-    sockFwd = -1;
+    wakeFds[0] = wakeFds[1] = -1;
+    stopping = 0;
+    generation = 0;
     if(nLibSshUsers == 0) {
 #ifdef _WIN32
         WSADATA wsadata;
@@ -73,75 +77,60 @@ SshThread::SshThread(SshParams &params) :
 #endif
         if(libssh2_init(0) != 0) {
             fprintf(stderr, "libssh2 initialization failed");
-            qApp->exit(1);
+            QCoreApplication::exit(1);
         }
-        nLibSshUsers++;
     }
+    nLibSshUsers++;
+    // tunnels may be added before the session is even up
+    if(!socketPair(wakeFds) || !setNonBlocking(wakeFds[0]))
+        qWarning("Could not create wakeup socket pair: %s", strerror(errno));
 }
 
 SshThread::~SshThread() {
+    closeSocket(wakeFds[0]);
+    closeSocket(wakeFds[1]);
     if(--nLibSshUsers == 0)
         libssh2_exit();
 }
 
-bool SshThread::createSocket() {
-    struct addrinfo* res;
-
-    { // get address info
-        struct addrinfo hints = {0};
-        hints.ai_family = PF_INET; // | PF_INET6
-        hints.ai_socktype = SOCK_STREAM;
-        hints.ai_protocol = IPPROTO_TCP;
-        int rc = getaddrinfo(params.sshHost.constData(), params.sshPort.constData(), &hints, &res);
-        if(rc != 0) {
-#ifdef _WIN32
-            emit tunnelFailed(gai_strerror(rc));
-#else
-            emit tunnelFailed(rc == EAI_SYSTEM ? strerror(errno) : gai_strerror(rc));
-#endif
-            return false;
-        }
-    }
-
-    int lastError = 0;
-    for(struct addrinfo* p = res; p; p = p->ai_next) {
-        if((sock = socket(p->ai_family, p->ai_socktype, p->ai_protocol)) < 0) {
-            lastError = errno;
-            continue;
-        }
-
-        if(::connect(sock, p->ai_addr, p->ai_addrlen) != 0) {
-            lastError = errno;
-            close(sock);
-            sock = -1;
-            continue;
-        }
-        break;
-    }
+void SshThread::fail(QString error) {
+    lastError = error;
+}
 
-    freeaddrinfo(res);
+template<typename F> void SshThread::forEachTunnel(F f) {
+    for(SshTunnel* t : tunnels)
+        f(t);
+}
 
-    if(lastError || sock < 0) {
-        emit tunnelFailed(strerror(lastError));
+bool SshThread::createSocket() {
+    SJ_TRACE("SshThread::createSocket", "ssh");
+    QString error;
+    // stop() interrupts a connect that is still in progress
+    sock = connectTcp(params.sshHost.constData(), params.sshPort.constData(), params.connectTimeout, &error, &stopping, wakeFds[0]);
+    if(sock < 0) {
+        fail(error);
         return false;
     }
-
     return true;
 }
 
 bool SshThread::createSession() {
+    SJ_TRACE("SshThread::createSession", "ssh");
     session = libssh2_session_init();
     if(session == nullptr) {
-        emit tunnelFailed("libssh2_session_init failed");
+        fail("libssh2_session_init failed");
         return false;
     }
 
+    if(params.compress)
+        libssh2_session_flag(session, LIBSSH2_FLAG_COMPRESS, 1);
+
     // trade banners, keys, setup crypto, compression, MAC
     int rc = libssh2_session_handshake(session, sock);
     if(rc) {
         char* msg = 0;
         libssh2_session_last_error(session, &msg, nullptr, 0);
-        emit tunnelFailed(msg);
+        fail(msg);
         free(msg);
         return false;
     }
@@ -175,26 +164,42 @@ bool SshThread::createSession() {
             fingerprintOk = true;
             break;
         case LIBSSH2_KNOWNHOST_CHECK_MISMATCH:
-            emit tunnelFailed("Server host key does not match that in known_hosts file");
+            fail("Server host key does not match that in known_hosts file");
             break;
         case LIBSSH2_KNOWNHOST_CHECK_NOTFOUND:
-            emit confirmUnknownHost(readableFingerprint, &fingerprintOk);
+            // nobody to ask while reconnecting, and it was known before
+            if(reconnecting) {
+                fail("Server host key is no longer in known_hosts file");
+                break;
+            }
+            { // ask on behalf of the first connection waiting for this session.
+                // Removing that tunnel or stopping counts as a no
+                QMutexLocker lock(&sessionLock);
+                asking = added.isEmpty() ? tunnels.value(0) : added.first();
+                hostKeyAnswered = false;
+                if(asking)
+                    emit asking->confirmUnknownHost(readableFingerprint);
+                while(asking && !hostKeyAnswered && !stopping)
+                    sessionChanged.wait(&sessionLock);
+                fingerprintOk = asking && hostKeyAnswered && hostKeyAccepted;
+                asking = nullptr;
+            }
             if(fingerprintOk) {
                 libssh2_knownhost_addc(knownHosts, params.sshHost.constData(), "", fingerprint, len,
                     nullptr, 0, LIBSSH2_KNOWNHOST_TYPE_PLAIN|LIBSSH2_KNOWNHOST_KEYENC_RAW|LIBSSH2_KNOWNHOST_KEY_SSHRSA, nullptr);
                 libssh2_knownhost_writefile(knownHosts, knownHostsFile.constData(), LIBSSH2_KNOWNHOST_FILE_OPENSSH);
             } else
-                emit tunnelFailed(QString{});
+                fail(QString{});
             break;
         case LIBSSH2_KNOWNHOST_CHECK_FAILURE:
-            emit tunnelFailed("Failed to check known hosts");
+            fail("Failed to check known hosts");
             break;
         default:
             Q_ASSERT("Branch can't happen" == 0);
             break;
         }
     } else {
-        emit tunnelFailed("Failed to get server host key");
+        fail("Failed to get server host key");
     }
     libssh2_knownhost_free(knownHosts);
 
@@ -206,12 +211,13 @@ bool SshThread::createSession() {
 
 
 bool SshThread::authenticate() {
+    SJ_TRACE("SshThread::authenticate", "ssh");
 
     const char* userauthlist = libssh2_userauth_list(session, params.sshUser.constData(), params.sshUser.length());
 
     if(params.useSshKey) {
         if(strstr(userauthlist, "publickey") == nullptr) {
-            emit tunnelFailed("Public Key authentication method not supported by server");
+            fail("Public Key authentication method not supported by server");
             return false;
         }
 
@@ -232,21 +238,21 @@ bool SshThread::authenticate() {
         if(libssh2_userauth_publickey_fromfile_ex(session,
                 params.sshUser.constData(), params.sshUser.length(),
                        useGuessedPublicKey ? publicKeyPath.constData() : nullptr, params.sshKeyPath.constData(), nullptr)) {
-            emit tunnelFailed("Public key authentication failed");
+            fail("Public key authentication failed");
             return false;
         }
 
     } else {
 
         if(strstr(userauthlist, "password") == nullptr) {
-            emit tunnelFailed("Password authentication method not supported by server");
+            fail("Password authentication method not supported by server");
             return false;
         }
 
         if (libssh2_userauth_password_ex(session,
                 params.sshUser.constData(), params.sshUser.length(),
                 params.sshPass.constData(), params.sshPass.length(), nullptr)) {
-            emit tunnelFailed("Password authentication failed");
+            fail("Password authentication failed");
             return false;
         }
     }
@@ -255,134 +261,595 @@ bool SshThread::authenticate() {
 
 }
 
-bool SshThread::setupTunnel() {
+// One local connection and the channel it is forwarded over
+struct SshThread::Forward {
+    enum State { OPENING, OPEN, CLOSING } state = OPENING;
+    SshTunnel* tunnel = nullptr; // cleared when the tunnel is removed
+    int sock = -1;
+    QByteArray originHost;
+    unsigned int originPort = 0;
+    LIBSSH2_CHANNEL* channel = nullptr;
+    bool localEof = false;
+
+    // data read from one side but not yet accepted by the other. The buffer
+    // grows while reads keep filling it, i.e. during bulk transfers, and
+    // shrinks back once traffic is interactive again
+    struct Pending {
+        enum { MIN_SIZE = 16 << 10, MAX_SIZE = 512 << 10 };
+        QByteArray buf = QByteArray(MIN_SIZE, Qt::Uninitialized);
+        ssize_t offset = 0;
+        ssize_t length = 0;
+        bool empty() const { return offset == length; }
+        char* data() { return buf.data(); }
+        int capacity() const { return buf.size(); }
+        void filled(ssize_t n) {
+            offset = 0;
+            length = n;
+        }
+        void adapt() {
+            if(length == buf.size() && buf.size() < MAX_SIZE)
+                buf.resize(buf.size() * 2);
+            else if(length < buf.size() / 8 && buf.size() > MIN_SIZE)
+                buf.resize(buf.size() / 2);
+        }
+    } toChannel, toLocal;
+};
+
+// libssh2_channel_direct_tcpip_ex always uses the default window and packet
+// sizes, so build the direct-tcpip request ourselves (RFC 4254 section 7.2)
+static LIBSSH2_CHANNEL* openDirectTcpip(LIBSSH2_SESSION* session, const QByteArray& host, int port,
+        const QByteArray& originHost, unsigned int originPort, unsigned int windowSize, unsigned int packetSize) {
+    QByteArray msg;
+    auto appendInt = [&](quint32 v) {
+        msg.append(char(v >> 24)).append(char(v >> 16)).append(char(v >> 8)).append(char(v));
+    };
+    appendInt(host.length());
+    msg.append(host);
+    appendInt(port);
+    appendInt(originHost.length());
+    msg.append(originHost);
+    appendInt(originPort);
+    static const char type[] = "direct-tcpip";
+    return libssh2_channel_open_ex(session, type, sizeof(type) - 1, windowSize, packetSize, msg.constData(), msg.length());
+}
+
+SshTunnel::SshTunnel(const SshParams &params, TunnelStats &stats, SshThread *session) :
+    params(params),
+    stats(stats),
+    session(session)
+{
+}
+
+bool SshTunnel::waitForSession(int msecs) const {
+    return session->waitForSession(msecs);
+}
+
+int SshTunnel::sessionGeneration() const {
+    return session->sessionGeneration();
+}
+
+// Listens on a Unix socket in a private directory. Returns false, leaving
+// errno set, if it can't be created
+bool SshTunnel::listenUnix() {
 #ifdef _WIN32
-    char sockopt;
+    errno = EAFNOSUPPORT;
+    return false;
 #else
-    int sockopt;
-#endif
-
-    struct sockaddr_in sin;
+    QByteArray dir = QDir::temp().filePath("sequeljoe-XXXXXX").toLocal8Bit();
+    if(mkdtemp(dir.data()) == nullptr)
+        return false;
+    socketDir = QString::fromLocal8Bit(dir);
+    QByteArray path = dir + '/' + params.socketName;
 
-    int localListenPort = localBoundPort++;
-    sockListen = socket(PF_INET, SOCK_STREAM, IPPROTO_TCP);
-    sin.sin_family = AF_INET;
-    sin.sin_port = htons(localListenPort);
-    sin.sin_addr.s_addr = inet_addr("127.0.0.1");
-    if(sin.sin_addr.s_addr == INADDR_NONE) {
-        emit tunnelFailed(strerror(errno));
+    struct sockaddr_un sun = {0};
+    if(size_t(path.length()) >= sizeof(sun.sun_path)) {
+        errno = ENAMETOOLONG;
+        close();
         return false;
     }
+    sun.sun_family = AF_UNIX;
+    strcpy(sun.sun_path, path.constData());
+    sockListen = socket(AF_UNIX, SOCK_STREAM, 0);
+    if(sockListen < 0 || bind(sockListen, (struct sockaddr*)&sun, sizeof(sun)) < 0) {
+        int err = errno;
+        close();
+        errno = err;
+        return false;
+    }
+    return true;
+#endif
+}
 
-    sockopt = 1;
-    setsockopt(sockListen, SOL_SOCKET, SO_REUSEADDR, &sockopt, sizeof(sockopt));
-
-    socklen_t sinlen = sizeof(sin);
+bool SshTunnel::listen() {
+    // the driver connects straight to a Unix socket if it can, saving the
+    // loopback TCP stack on every byte
+    if(!params.socketName.isEmpty() && !listenUnix())
+        qWarning("Could not create local socket, falling back to TCP: %s", strerror(errno));
+
+    int localListenPort = 0;
+    if(sockListen < 0) {
+        // port 0 lets the kernel choose one that is free
+        struct sockaddr_in sin = {0};
+        sin.sin_family = AF_INET;
+        sin.sin_port = 0;
+        sin.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+        socklen_t sinlen = sizeof(sin);
+
+        sockListen = socket(PF_INET, SOCK_STREAM, IPPROTO_TCP);
+        if(sockListen < 0 || bind(sockListen, (struct sockaddr *)&sin, sinlen) < 0 ||
+                getsockname(sockListen, (struct sockaddr *)&sin, &sinlen) < 0) {
+            emit failed(strerror(errno));
+            close();
+            return false;
+        }
+        localListenPort = ntohs(sin.sin_port);
+    }
 
-    if(bind(sockListen, (struct sockaddr *)&sin, sinlen) < 0) {
-        emit tunnelFailed(strerror(errno));
+    // connections are accepted for as long as the tunnel is up, each one
+    // gets its own channel over the session
+    if(::listen(sockListen, 16) < 0 || !setNonBlocking(sockListen)) {
+        emit failed(strerror(errno));
+        close();
         return false;
     }
 
-    if(listen(sockListen, 2) < 0) {
-        emit tunnelFailed(strerror(errno));
-        return false;
+    if(socketDir.isEmpty())
+        emit opened("127.0.0.1", localListenPort);
+    else
+        emit socketOpened(socketDir);
+    return true;
+}
+
+void SshTunnel::close() {
+    closeSocket(sockListen);
+    sockListen = -1;
+    if(!socketDir.isEmpty()) {
+        QDir(socketDir).removeRecursively();
+        socketDir.clear();
     }
+}
+
+void SshTunnel::answerUnknownHost(bool ok) {
+    session->answerUnknownHost(this, ok);
+}
 
-    // actually we shouldn't emit until after accept, but that's tricky
-    emit sshTunnelOpened("127.0.0.1", localListenPort);
+void SshTunnel::open() {
+    QString error;
+    if(!session->addTunnel(this, &error))
+        emit failed(error);
+}
 
-    sockFwd = accept(sockListen, (struct sockaddr *)&sin, &sinlen);
-    if(sockFwd < 0) {
-        emit tunnelFailed(strerror(errno));
+bool SshThread::addTunnel(SshTunnel* tunnel, QString* error) {
+    QMutexLocker lock(&sessionLock);
+    if(finished) {
+        *error = finishError;
         return false;
     }
+    added.append(tunnel);
+    send(wakeFds[1], "x", 1, 0);
+    return true;
+}
 
-    const char* shost = inet_ntoa(sin.sin_addr);
-    unsigned int sport = ntohs(sin.sin_port);
+bool SshThread::isFinished() {
+    QMutexLocker lock(&sessionLock);
+    return finished;
+}
 
-    channel = libssh2_channel_direct_tcpip_ex(session, params.remoteHost.constData(), params.remotePort, shost, sport);
-    if (!channel) {
-        emit tunnelFailed("Could not open direct TCP/IP channel. Please review the server logs");
-        return false;
+void SshThread::answerUnknownHost(SshTunnel* tunnel, bool ok) {
+    QMutexLocker lock(&sessionLock);
+    if(asking != tunnel)
+        return;
+    hostKeyAnswered = true;
+    hostKeyAccepted = ok;
+    sessionChanged.wakeAll();
+}
+
+void SshThread::removeTunnel(SshTunnel* tunnel) {
+    QMutexLocker lock(&sessionLock);
+    // an unanswered question about the host key is answered no
+    if(asking == tunnel) {
+        asking = nullptr;
+        sessionChanged.wakeAll();
+    }
+    // never got as far as listening
+    if(added.removeOne(tunnel))
+        return;
+    if(!finished) {
+        removed.append(tunnel);
+        send(wakeFds[1], "x", 1, 0);
+        while(tunnels.contains(tunnel) && !finished)
+            sessionChanged.wait(&sessionLock);
     }
+    // the pump has stopped, nobody else touches its sockets now
+    removed.removeOne(tunnel);
+    tunnels.removeOne(tunnel);
+    tunnel->close();
+}
 
-    return true;
+// Applies the tunnel changes handed over by addTunnel and removeTunnel
+void SshThread::updateTunnels() {
+    QMutexLocker lock(&sessionLock);
+    if(!removed.isEmpty()) {
+        for(SshTunnel* t : removed) {
+            // forwards finish closing on their own, without their tunnel
+            for(Forward* f : forwards) {
+                if(f->tunnel == t) {
+                    f->tunnel = nullptr;
+                    f->state = Forward::CLOSING;
+                }
+            }
+            t->close();
+            tunnels.removeOne(t);
+        }
+        removed.clear();
+        sessionChanged.wakeAll();
+    }
+    for(SshTunnel* t : added) {
+        t->listen();
+        tunnels.append(t);
+    }
+    added.clear();
 }
 
-void SshThread::routeTraffic() {
-    libssh2_session_set_blocking(session, 0);
+void SshThread::drainWake() {
+    char buf[64];
+    while(recv(wakeFds[0], buf, sizeof(buf), 0) > 0)
+        ;
+}
+
+void SshThread::stop() {
+    stopping = 1;
+    QMutexLocker lock(&sessionLock);
+    if(wakeFds[1] >= 0)
+        send(wakeFds[1], "x", 1, 0);
+    sessionChanged.wakeAll();
+}
+
+bool SshThread::waitForSession(int msecs) {
+    QElapsedTimer timer;
+    timer.start();
+    QMutexLocker lock(&sessionLock);
+    while(!sessionUp && !stopping) {
+        qint64 remaining = msecs - timer.elapsed();
+        if(remaining <= 0)
+            break;
+        sessionChanged.wait(&sessionLock, remaining);
+    }
+    return sessionUp;
+}
+
+void SshThread::setSessionUp(bool up) {
+    QMutexLocker lock(&sessionLock);
+    sessionUp = up;
+    sessionChanged.wakeAll();
+}
 
-    // select loop
-    struct timeval tv;
-    fd_set fds;
-    char buf[16384];
-    memset(buf, 0, sizeof(buf));
+QString SshThread::sessionError() const {
+    char* msg = 0;
+    libssh2_session_last_error(session, &msg, nullptr, 0);
+    return QString(msg);
+}
 
+void SshThread::acceptConnections(SshTunnel* tunnel) {
     while(true) {
-        FD_ZERO(&fds);
-        FD_SET(sockFwd, &fds);
-        tv.tv_sec = 0;
-        tv.tv_usec = 100000;
-
-        int rc = select(sockFwd + 1, &fds, nullptr, nullptr, &tv);
-        if(rc < 0)
-            return tunnelFailed(strerror(errno));
-
-        if(rc > 0 && FD_ISSET(sockFwd, &fds)) {
-            ssize_t len = recv(sockFwd, buf, sizeof(buf), 0);
-            if(len < 0) {
-                char* msg = 0;
-                libssh2_session_last_error(session, &msg, nullptr, 0);
-                emit tunnelFailed(msg);
-                free(msg);
-                return;
-            }
-            else if (0 == len)
-                return; // tunnelFailed("The client at %s:%d disconnected!\n", shost, sport);
-            ssize_t n = 0;
-            int i;
-            do {
-                i = libssh2_channel_write(channel, buf, len);
-                if (i < 0) {
-                    char* msg = 0;
-                    libssh2_session_last_error(session, &msg, nullptr, 0);
-                    emit tunnelFailed(msg);
-                    free(msg);
-                    return;
-                }
-                n += i;
-            } while(i > 0 && n < len);
+        struct sockaddr_storage addr;
+        socklen_t addrlen = sizeof(addr);
+        int fd = accept(tunnel->sockListen, (struct sockaddr *)&addr, &addrlen);
+        if(fd < 0)
+            return; // would block, or a connection that went away already
+        if(!setNonBlocking(fd)) {
+            closeSocket(fd);
+            continue;
+        }
+        Forward* f = new Forward;
+        f->tunnel = tunnel;
+        f->sock = fd;
+        if(addr.ss_family == AF_INET) {
+            struct sockaddr_in* sin = (struct sockaddr_in*) &addr;
+            f->originHost = inet_ntoa(sin->sin_addr);
+            f->originPort = ntohs(sin->sin_port);
+        } else {
+            f->originHost = "127.0.0.1"; // a Unix socket peer has no address
         }
-        while(true) {
-            ssize_t len = libssh2_channel_read(channel, buf, sizeof(buf));
+        forwards.append(f);
+    }
+}
+
+// Moves as much data as it can for one forward without blocking. Returns
+// false if the session itself has failed
+bool SshThread::pump(Forward* f, bool* progress) {
+    if(f->state == Forward::OPENING) {
+        const SshParams& p = f->tunnel->params;
+        f->channel = openDirectTcpip(session, p.remoteHost, p.remotePort, f->originHost, f->originPort, p.windowSize, p.packetSize);
+        if(!f->channel) {
+            if(libssh2_session_last_errno(session) == LIBSSH2_ERROR_EAGAIN)
+                return true;
+            // refused for this connection only, e.g. by the server's policy
+            qWarning("Could not open direct TCP/IP channel: %s", qPrintable(sessionError()));
+            f->state = Forward::CLOSING;
+            return true;
+        }
+        f->state = Forward::OPEN;
+        *progress = true;
+    }
 
-            if (LIBSSH2_ERROR_EAGAIN == len)
+    if(f->state == Forward::CLOSING) {
+        if(f->channel) {
+            int rc = libssh2_channel_free(f->channel);
+            if(rc == LIBSSH2_ERROR_EAGAIN)
+                return true;
+            f->channel = nullptr;
+        }
+        closeSocket(f->sock);
+        f->sock = -1;
+        *progress = true;
+        return true;
+    }
+
+    // local socket -> channel
+    if(f->toChannel.empty() && !f->localEof) {
+        f->toChannel.adapt();
+        ssize_t len = recv(f->sock, f->toChannel.data(), f->toChannel.capacity(), 0);
+        if(len > 0) {
+            f->toChannel.filled(len);
+        } else if(len == 0 || !wouldBlock()) {
+            f->localEof = true; // the database client disconnected
+        }
+    }
+    while(!f->toChannel.empty()) {
+        ssize_t n = libssh2_channel_write(f->channel, f->toChannel.data() + f->toChannel.offset, f->toChannel.length - f->toChannel.offset);
+        if(n == LIBSSH2_ERROR_EAGAIN) {
+            // either the socket is full or the server hasn't opened the window
+            if(libssh2_channel_window_write(f->channel) == 0)
+                f->tunnel->stats.windowStalls.ref();
+            break;
+        }
+        if(n < 0)
+            return false;
+        f->toChannel.offset += n;
+        f->tunnel->stats.bytesOut.fetchAndAddRelaxed(n);
+        *progress = true;
+    }
+
+    // channel -> local socket
+    if(f->toLocal.empty()) {
+        f->toLocal.adapt();
+        ssize_t len = libssh2_channel_read(f->channel, f->toLocal.data(), f->toLocal.capacity());
+        if(len > 0) {
+            f->toLocal.filled(len);
+            f->tunnel->stats.bytesIn.fetchAndAddRelaxed(len);
+        } else if(len != LIBSSH2_ERROR_EAGAIN && len < 0) {
+            return false;
+        }
+    }
+    while(!f->toLocal.empty()) {
+        ssize_t n = send(f->sock, f->toLocal.data() + f->toLocal.offset, f->toLocal.length - f->toLocal.offset, 0);
+        if(n < 0) {
+            if(wouldBlock())
                 break;
-            else if (len < 0)  {
-                char* msg = 0;
-                libssh2_session_last_error(session, &msg, nullptr, 0);
-                emit tunnelFailed(msg);
-                free(msg);
-                return;
-            }
-            ssize_t n = 0;
-            int i;
-            while (n < len) {
-                i = send(sockFwd, buf + n, len - n, 0);
-                if (i <= 0) {
-                    char* msg = 0;
-                    libssh2_session_last_error(session, &msg, nullptr, 0);
-                    emit tunnelFailed(msg);
-                    free(msg);
-                    return;
+            f->localEof = true;
+            f->toLocal.offset = f->toLocal.length;
+            break;
+        }
+        f->toLocal.offset += n;
+        *progress = true;
+    }
+
+    if((f->localEof && f->toChannel.empty()) || (f->toLocal.empty() && libssh2_channel_eof(f->channel))) {
+        f->state = Forward::CLOSING;
+        *progress = true;
+    }
+    return true;
+}
+
+// Services the listening sockets and every forward from a single loop. Both
+// the SSH socket and the local sockets are non-blocking, and we only sleep in
+// poll() once nothing can make progress. On the SSH socket we wait for
+// whatever libssh2 reports it is blocked on, plus incoming data whenever a
+// forward has room to take it. Returns a description of the failure if the
+// session is lost, or an empty string once stop() is called
+QString SshThread::routeTraffic() {
+    libssh2_session_set_blocking(session, 0);
+    // keepalives with want_reply set give us something to hear back even
+    // when every forward is idle, so a dead link shows up as silence
+    libssh2_keepalive_config(session, 1, KEEPALIVE_INTERVAL);
+
+    QElapsedTimer silence;
+    silence.start();
+    // a keepalive reply is the first thing to arrive after an idle send, so
+    // the time until the SSH socket turns readable is the round trip
+    QElapsedTimer sinceKeepalive;
+    QElapsedTimer rttProbe;
+    bool woken = false;
+    QVector<struct pollfd> fds;
+    QVector<SshTunnel*> listeners;
+    while(!stopping) {
+        updateTunnels();
+
+        bool progress;
+        bool moved = false;
+        TraceSpan span("SshThread::pump", "ssh");
+        do {
+            progress = false;
+            for(int i = 0; i < forwards.count(); ++i) {
+                Forward* f = forwards.at(i);
+                if(!pump(f, &progress))
+                    return sessionError();
+                if(f->state == Forward::CLOSING && f->sock == -1) {
+                    forwards.removeAt(i--);
+                    delete f;
                 }
-                n += i;
             }
-            if (libssh2_channel_eof(channel))
-                return tunnelFailed("Disconnected by remote host");
+            moved |= progress;
+        } while(progress && !stopping);
+        // idle wakeups would drown out everything else
+        span.setArg("forwards", forwards.count());
+        if(moved)
+            span.end();
+        else
+            span.discard();
+        if(woken && !moved)
+            forEachTunnel([](SshTunnel* t) { t->stats.eagainSpins.ref(); });
+        if(moved)
+            rttProbe.invalidate(); // other traffic would skew the measurement
+
+        // nothing reads the SSH socket without a forward, so it is only
+        // watched for errors then. Keepalive replies wait in the kernel
+        bool wantSshRead = false;
+        fds.resize(2);
+        fds[0].fd = wakeFds[0];
+        fds[0].events = POLLIN;
+        fds[1].fd = sock;
+        fds[1].events = 0;
+        listeners.clear();
+        for(SshTunnel* t : tunnels) {
+            int n = 0;
+            for(Forward* f : forwards)
+                n += f->tunnel == t;
+            t->stats.forwards.store(n);
+            if(t->sockListen < 0)
+                continue;
+            struct pollfd p;
+            p.fd = t->sockListen;
+            p.events = POLLIN;
+            p.revents = 0;
+            fds.append(p);
+            listeners.append(t);
+        }
+        for(Forward* f : forwards) {
+            if(f->state != Forward::OPEN)
+                continue;
+            struct pollfd p;
+            p.fd = f->sock;
+            p.events = 0;
+            p.revents = 0;
+            if(f->toChannel.empty() && !f->localEof)
+                p.events |= POLLIN;
+            if(!f->toLocal.empty())
+                p.events |= POLLOUT;
+            else
+                wantSshRead = true;
+            fds.append(p);
         }
+        int dirs = libssh2_session_block_directions(session);
+        if((dirs & LIBSSH2_SESSION_BLOCK_INBOUND) || wantSshRead)
+            fds[1].events |= POLLIN;
+        if(dirs & LIBSSH2_SESSION_BLOCK_OUTBOUND)
+            fds[1].events |= POLLOUT;
+
+        // only a forward pulls the replies out of libssh2, so silence
+        // doesn't count while there is none to read them
+        bool listening = !forwards.isEmpty() && (fds[1].events & POLLIN);
+        if(!listening)
+            silence.restart();
+
+        int nextKeepalive = KEEPALIVE_INTERVAL;
+        if(libssh2_keepalive_send(session, &nextKeepalive) < 0 && libssh2_session_last_errno(session) != LIBSSH2_ERROR_EAGAIN)
+            return sessionError();
+        // it reports the full interval for the rest of the second it sent in
+        if(nextKeepalive == KEEPALIVE_INTERVAL && (!sinceKeepalive.isValid() || sinceKeepalive.hasExpired(1000))) {
+            sinceKeepalive.start();
+            if(listening)
+                rttProbe.start();
+        }
+
+        int ready = poll(fds.data(), fds.count(), qMax(nextKeepalive, 1) * 1000);
+        if(ready < 0 && !wouldBlock())
+            return strerror(errno);
+        woken = ready > 0;
+
+        if(fds[1].revents & (POLLERR | POLLHUP))
+            return "Connection to SSH server lost";
+        if(fds[1].revents & POLLIN) {
+            silence.restart();
+            if(rttProbe.isValid()) {
+                qint64 rtt = rttProbe.nsecsElapsed() / 1000;
+                forEachTunnel([rtt](SshTunnel* t) { t->stats.sampleRtt(rtt); });
+                rttProbe.invalidate();
+            }
+        }
+        else if(listening && silence.hasExpired(KEEPALIVE_INTERVAL * KEEPALIVE_MAX_MISSED * 1000))
+            return "SSH server stopped responding";
+
+        if(fds[0].revents & POLLIN)
+            drainWake();
+        for(int i = 0; i < listeners.count(); ++i) {
+            if(fds[2 + i].revents & POLLIN)
+                acceptConnections(listeners.at(i));
+        }
+    }
+    return QString();
+}
+
+// Sleeps for msecs while still applying tunnel changes, returns false if
+// woken early by stop()
+bool SshThread::backoff(int msecs) {
+    QElapsedTimer timer;
+    timer.start();
+    while(!stopping && !timer.hasExpired(msecs)) {
+        struct pollfd p;
+        p.fd = wakeFds[0];
+        p.events = POLLIN;
+        p.revents = 0;
+        if(poll(&p, 1, msecs - timer.elapsed()) > 0) {
+            drainWake();
+            updateTunnels();
+        }
+    }
+    return !stopping;
+}
+
+// Drops the forwards and the SSH session after the link has gone away, but
+// keeps the listening sockets so the local endpoints survive a reconnect
+void SshThread::closeSession() {
+    // the channels died with the session, libssh2_session_free releases them
+    for(Forward* f : forwards) {
+        closeSocket(f->sock);
+        delete f;
+    }
+    forwards.clear();
+
+    if(session) {
+        libssh2_session_free(session);
+        session = nullptr;
+    }
+    closeSocket(sock);
+    sock = -1;
+}
+
+bool SshThread::reconnect() {
+    reconnecting = true;
+    int delay = 1;
+    for(int i = 0; i < RECONNECT_ATTEMPTS; ++i) {
+        if(!backoff(delay * 1000))
+            break;
+        if(createSocket() && createSession() && authenticate()) {
+            reconnecting = false;
+            return true;
+        }
+        closeSession();
+        delay = qMin(delay * 2, (int) RECONNECT_MAX_DELAY);
+    }
+    reconnecting = false;
+    return false;
+}
+
+// Reports a session that is gone for good to every tunnel, including those
+// still waiting for it. addTunnel refuses new ones from now on
+void SshThread::finish(QString error) {
+    QMutexLocker lock(&sessionLock);
+    finished = true;
+    finishError = error;
+    QList<SshTunnel*> all = tunnels + added;
+    for(SshTunnel* t : all) {
+        t->close();
+        if(!stopping)
+            emit t->failed(error);
     }
+    tunnels = all;
+    added.clear();
+    removed.clear();
+    sessionChanged.wakeAll();
 }
 
 void SshThread::connectToServer() {
@@ -390,34 +857,53 @@ void SshThread::connectToServer() {
     { // Connect to SSH server
         if(createSocket() &&
             createSession() &&
-            authenticate() &&
-            setupTunnel()
-        )
-            // this function blocks until the database disconnects
-            routeTraffic();
+            authenticate()
+        ) {
+            setSessionUp(true);
+            // blocks until the session is stopped, or fails and can't be
+            // re-established
+            while(true) {
+                QString error = routeTraffic();
+                setSessionUp(false);
+                if(stopping)
+                    break;
+                forEachTunnel([&error](SshTunnel* t) { emit t->lost(error); });
+                closeSession();
+                if(!reconnect()) {
+                    if(lastError.isEmpty())
+                        lastError = error;
+                    break;
+                }
+                generation.ref();
+                setSessionUp(true);
+                forEachTunnel([](SshTunnel* t) {
+                    t->stats.reconnects.ref();
+                    emit t->restored();
+                });
+            }
+        }
     }
 
     // tear everything down
 
-    if(channel)
-        libssh2_channel_free(channel);
-
-#ifdef _WIN32
-    closesocket(sockFwd);
-    closesocket(sockListen);
-#else
-    close(sockFwd);
-    close(sockListen);
-#endif
+    if(session)
+        libssh2_session_set_blocking(session, 1);
+    for(Forward* f : forwards) {
+        if(f->channel)
+            libssh2_channel_free(f->channel);
+        closeSocket(f->sock);
+        delete f;
+    }
+    forwards.clear();
 
     if(session) {
         libssh2_session_disconnect(session, "Client disconnecting normally");
         libssh2_session_free(session);
+        session = nullptr;
     }
 
-#ifdef _WIN32
-    closesocket(sock);
-#else
-    close(sock);
-#endif
+    closeSocket(sock);
+    sock = -1;
+
+    finish(lastError);
 }
@@ -13,42 +13,150 @@ struct _LIBSSH2_CHANNEL;
 
 #include <QByteArray>
 #include <QObject>
+#include <QList>
+#include <QString>
+#include <QAtomicInt>
+#include <QMutex>
+#include <QWaitCondition>
 
-class SshParams;
+#include "dbconnection.h"
 
+struct TunnelStats;
+class SshThread;
+
+// One database endpoint forwarded over a shared SSH session: a local socket
+// whose connections are each opened as a channel to params.remoteHost.
+// Created and destroyed by SshSessionPool; signals are emitted from the
+// session's thread
+class SshTunnel : public QObject
+{
+    Q_OBJECT
+public:
+    // may be called from any thread. Blocks until the SSH session is up,
+    // e.g. after a reconnect, the session stops, or msecs elapse
+    bool waitForSession(int msecs) const;
+    // incremented each time the session is re-established
+    int sessionGeneration() const;
+
+    // starts listening once the session is up. Connect to the signals first
+    void open();
+    // may be called from any thread, the reply to confirmUnknownHost
+    void answerUnknownHost(bool ok);
+
+signals:
+    void opened(QString host, int port);
+    // listening on a Unix socket named params.socketName in dir
+    void socketOpened(QString dir);
+    void failed(QString reason);
+    // the SSH link dropped; connections wait until restored
+    void lost(QString reason);
+    void restored();
+    // the session waits for answerUnknownHost
+    void confirmUnknownHost(QString fingerprint);
+
+private:
+    friend class SshThread;
+    friend class SshSessionPool;
+
+    SshTunnel(const SshParams& params, TunnelStats& stats, SshThread* session);
+    bool listen();
+    bool listenUnix();
+    void close();
+
+    const SshParams& params;
+    TunnelStats& stats;
+    SshThread* session;
+    int sockListen = -1;
+    QString socketDir;
+};
+
+// An authenticated SSH session and the tunnels forwarded over it, serviced
+// from a single thread. Shared through SshSessionPool
 class SshThread : public QObject
 {
     Q_OBJECT
 public:
-    SshThread(SshParams& params);
+    explicit SshThread(const SshParams& params);
     virtual ~SshThread();
 
+    // may be called from any thread, makes connectToServer return
+    void stop();
+
+    // may be called from any thread. Returns false with the reason once the
+    // session has failed for good, in which case the tunnel is not taken
+    bool addTunnel(SshTunnel* tunnel, QString* error);
+    bool isFinished();
+    // may be called from any thread. Blocks until the tunnel's sockets and
+    // connections are closed
+    void removeTunnel(SshTunnel* tunnel);
+    // may be called from any thread. Ignored unless tunnel is being asked
+    void answerUnknownHost(SshTunnel* tunnel, bool ok);
+
+    bool waitForSession(int msecs);
+    int sessionGeneration() const { return generation; }
+
 public slots:
     void connectToServer();
 
-signals:
-    void sshTunnelOpened(QString,int);
-    void tunnelFailed(QString);
-    void confirmUnknownHost(QString fingerprint, bool* ok); //< should be blocked
-
 private:
+    struct Forward;
+
+    enum {
+        KEEPALIVE_INTERVAL = 5, // seconds
+        KEEPALIVE_MAX_MISSED = 3,
+        RECONNECT_ATTEMPTS = 8,
+        RECONNECT_MAX_DELAY = 30 // seconds
+    };
+
     bool createSocket();
     bool createSession();
     bool authenticate();
-    bool setupTunnel();
-    void routeTraffic();
+    QString routeTraffic();
+    bool reconnect();
+    bool backoff(int msecs);
+    void closeSession();
+    void setSessionUp(bool up);
+    void fail(QString error);
+    void finish(QString error);
+    void updateTunnels();
+    void acceptConnections(SshTunnel* tunnel);
+    bool pump(Forward* f, bool* progress);
+    void drainWake();
+    template<typename F> void forEachTunnel(F f);
+    QString sessionError() const;
 
     int sock;
-    int sockFwd;
-    int sockListen;
+    // written to by stop() and by tunnel changes to wake the pump
+    int wakeFds[2];
+    QAtomicInt stopping;
+    QAtomicInt generation;
+
+    // set while the session is being re-established
+    bool reconnecting = false;
+    QString lastError;
+
+    QMutex sessionLock;
+    QWaitCondition sessionChanged;
+    bool sessionUp = false;
+
+    // tunnel changes are handed over under sessionLock and applied by the
+    // pump, removeTunnel waits on sessionChanged until they are done
+    QList<SshTunnel*> tunnels;
+    QList<SshTunnel*> added;
+    QList<SshTunnel*> removed;
+    // the tunnel confirmUnknownHost was emitted from, until answered
+    SshTunnel* asking = nullptr;
+    bool hostKeyAnswered = false;
+    bool hostKeyAccepted = false;
+    bool finished = false;
+    QString finishError;
 
     _LIBSSH2_SESSION *session = nullptr;
-    _LIBSSH2_CHANNEL *channel = nullptr;
+    QList<Forward*> forwards;
 
-    const SshParams& params;
+    const SshParams params;
 
     static int nLibSshUsers;
-    static int localBoundPort;
 };
 
 #endif // _SEQUELJOE_SSHTHREAD_H_
@@ -0,0 +1,127 @@
+/*
+ * Copyright 2014 Oliver Giles
+ *
+ * This file is part of SequelJoe. SequelJoe is licensed under the
+ * GNU GPL version 3. See LICENSE or <http://www.gnu.org/licenses/>
+ * for more information
+ */
+#include "statementindex.h"
+#include "sqllexer.h"
+
+#include <QTextDocument>
+#include <QTextBlock>
+#include <algorithm>
+
+StatementIndex::StatementIndex(QTextDocument *doc) :
+    QObject(doc),
+    doc(doc),
+    hashComments(false),
+    lastFound(0)
+{
+    connect(doc, SIGNAL(contentsChange(int,int,int)), this, SLOT(contentsChange(int,int,int)));
+    rebuild();
+}
+
+StatementIndex::Range StatementIndex::statement(int i) const {
+    Range r;
+    r.from = i == 0 ? 0 : ends.at(i - 1);
+    // characterCount includes the final paragraph separator
+    r.to = i < ends.count() ? ends.at(i) : length - 1;
+    return r;
+}
+
+StatementIndex::Range StatementIndex::statementAt(int position) const {
+    // the cursor mostly stays within the statement it was last found in
+    int i = qMin(lastFound, ends.count());
+    if((i > 0 && ends.at(i - 1) > position) || (i < ends.count() && ends.at(i) <= position))
+        i = std::upper_bound(ends.begin(), ends.end(), position) - ends.begin();
+    lastFound = i;
+    if(i > 0) {
+        // only whitespace between the previous statement and the cursor
+        int p = ends.at(i - 1);
+        while(p < position && doc->characterAt(p) != QChar::ParagraphSeparator && doc->characterAt(p).isSpace())
+            ++p;
+        if(p == position)
+            --i;
+    }
+    return statement(i);
+}
+
+QVector<StatementIndex::Range> StatementIndex::statements() const {
+    QVector<Range> all;
+    all.reserve(count());
+    for(int i = 0; i < count(); ++i)
+        all.append(statement(i));
+    return all;
+}
+
+void StatementIndex::setHashComments(bool enable) {
+    if(enable == hashComments)
+        return;
+    hashComments = enable;
+    rebuild();
+    emit statementsChanged();
+}
+
+void StatementIndex::rebuild() {
+    ends.clear();
+    length = doc->characterCount();
+    scan(0, QVector<int>());
+}
+
+void StatementIndex::contentsChange(int position, int removed, int added) {
+    int delta = added - removed;
+    // QTextDocument sometimes reports changes to the final block inaccurately.
+    // Don't try to be clever about it
+    if(length + delta != doc->characterCount()) {
+        rebuild();
+        emit statementsChanged();
+        return;
+    }
+    length = doc->characterCount();
+
+    // statements ending before the change are unaffected, and lexing can
+    // restart in the default state after the last of them
+    int keep = std::upper_bound(ends.begin(), ends.end(), position) - ends.begin();
+    int restart = keep ? ends.at(keep - 1) : 0;
+
+    // statement ends after the change are still valid once shifted, provided
+    // the lexer reaches them in the default state
+    QVector<int> known;
+    for(int i = keep; i < ends.count(); ++i) {
+        if(ends.at(i) > position + removed)
+            known.append(ends.at(i) + delta);
+    }
+    ends.resize(keep);
+    scan(restart, known);
+    emit statementsChanged();
+}
+
+void StatementIndex::scan(int from, const QVector<int>& known) {
+    SqlLexer::State state = SqlLexer::STATE_NONE;
+    int k = 0;
+
+    QTextBlock block = doc->findBlock(from);
+    int i = from - block.position();
+    while(block.isValid()) {
+        const QString text = block.text();
+        SqlLexer lexer(text, state, hashComments, i);
+        SqlLexer::Token t;
+        while(lexer.next(&t)) {
+            if(t.type != SqlLexer::TOKEN_SEMICOLON)
+                continue;
+            int end = block.position() + t.from + 1;
+            ends.append(end);
+            while(k < known.count() && known.at(k) < end)
+                ++k;
+            if(k < known.count() && known.at(k) == end) {
+                // back in step with the previous scan, the rest is unchanged
+                ends += known.mid(k + 1);
+                return;
+            }
+        }
+        state = lexer.state();
+        block = block.next();
+        i = 0;
+    }
+}
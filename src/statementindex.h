@@ -0,0 +1,63 @@
+/*
+ * Copyright 2014 Oliver Giles
+ *
+ * This file is part of SequelJoe. SequelJoe is licensed under the
+ * GNU GPL version 3. See LICENSE or <http://www.gnu.org/licenses/>
+ * for more information
+ */
+#ifndef _SEQUELJOE_STATEMENTINDEX_H_
+#define _SEQUELJOE_STATEMENTINDEX_H_
+
+#include <QObject>
+#include <QVector>
+
+class QTextDocument;
+
+// Tracks where each statement of a query document ends, ignoring semicolons
+// in strings and comments as SqlLexer finds them. The index is updated incrementally on every edit:
+// lexing restarts at the end of the last statement before the change and stops
+// as soon as it finds a statement end that was already known.
+class StatementIndex : public QObject
+{
+    Q_OBJECT
+public:
+    explicit StatementIndex(QTextDocument* doc);
+
+    // whether # starts a comment, see SqlLexer
+    void setHashComments(bool enable);
+
+    struct Range {
+        int from;
+        int to; // one past the terminating semicolon, or the end of the document
+    };
+
+    int count() const { return ends.count() + 1; }
+    Range statement(int i) const;
+    // the statement a cursor at this position refers to. A cursor following
+    // a statement on the same line (e.g. after typing the semicolon) refers
+    // to that statement rather than the empty one after it. Constant time
+    // while the position stays in the same statement as the last call,
+    // otherwise a binary search over the statement ends
+    Range statementAt(int position) const;
+    QVector<Range> statements() const;
+
+signals:
+    void statementsChanged();
+
+private slots:
+    void contentsChange(int position, int removed, int added);
+
+private:
+    void rebuild();
+    void scan(int from, const QVector<int>& known);
+
+    QTextDocument* doc;
+    // document position one past each statement-terminating semicolon, ascending
+    QVector<int> ends;
+    int length;
+    bool hashComments;
+    // the statement statementAt found last, checked first next time
+    mutable int lastFound;
+};
+
+#endif // _SEQUELJOE_STATEMENTINDEX_H_
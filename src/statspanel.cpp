@@ -0,0 +1,119 @@
+/*
+ * Copyright 2014 Oliver Giles
+ *
+ * This file is part of SequelJoe. SequelJoe is licensed under the
+ * GNU GPL version 3. See LICENSE or <http://www.gnu.org/licenses/>
+ * for more information
+ */
+#include "statspanel.h"
+
+#include "dbconnection.h"
+
+#include <QApplication>
+#include <QClipboard>
+#include <QFormLayout>
+#include <QJsonDocument>
+#include <QLabel>
+#include <QPushButton>
+#include <QTimer>
+
+static QString formatBytes(double bytes) {
+    static const char* units[] = {"B", "KB", "MB", "GB", "TB"};
+    int u = 0;
+    while(bytes >= 1024 && u < 4) {
+        bytes /= 1024;
+        u++;
+    }
+    return QString::number(bytes, 'f', u == 0 ? 0 : 1) + " " + units[u];
+}
+
+StatsPanel::StatsPanel(QWidget *parent) :
+    QWidget(parent),
+    db(nullptr)
+{
+    form = new QFormLayout(this);
+    queries = addRow("Queries");
+    queryTime = addRow("Query time");
+    fetched = addRow("Fetched");
+    tunnelIn = addRow("SSH in");
+    tunnelOut = addRow("SSH out");
+    rtt = addRow("SSH round trip");
+    stalls = addRow("Window stalls / idle wakeups");
+    forwards = addRow("Tunnel connections");
+
+    QPushButton* copy = new QPushButton("Copy as JSON", this);
+    connect(copy, SIGNAL(clicked()), this, SLOT(copySnapshot()));
+    form->addRow(copy);
+
+    timer = new QTimer(this);
+    timer->setInterval(1000);
+    connect(timer, SIGNAL(timeout()), this, SLOT(refresh()));
+}
+
+QLabel* StatsPanel::addRow(QString label) {
+    QLabel* value = new QLabel(this);
+    value->setTextInteractionFlags(Qt::TextSelectableByMouse);
+    form->addRow(label, value);
+    return value;
+}
+
+void StatsPanel::setConnection(const DbConnection* connection) {
+    db = connection;
+    lastIn = lastOut = 0;
+    sinceRefresh.invalidate();
+    refresh();
+}
+
+void StatsPanel::showEvent(QShowEvent *) {
+    refresh();
+    timer->start();
+}
+
+void StatsPanel::hideEvent(QHideEvent *) {
+    timer->stop();
+}
+
+void StatsPanel::refresh() {
+    if(!db) {
+        for(QLabel* l : {queries, queryTime, fetched, tunnelIn, tunnelOut, rtt, stalls, forwards})
+            l->clear();
+        return;
+    }
+
+    const QueryStats& q = db->queryStatistics();
+    quint64 n = q.queries.load();
+    queries->setText(QString::number(n) + " (" + QString::number(q.errors.load()) + " failed)");
+    queryTime->setText(n ? QString::number(q.queryMicros.load() / 1000.0 / n, 'f', 1) + " ms average" : QString());
+    fetched->setText(QString::number(q.rowsFetched.load()) + " rows, " + formatBytes(q.bytesFetched.load()));
+
+    const TunnelStats* t = db->tunnelStatistics();
+    for(QWidget* w : {tunnelIn, tunnelOut, rtt, stalls, forwards}) {
+        w->setVisible(t != nullptr);
+        form->labelForField(w)->setVisible(t != nullptr);
+    }
+    if(!t)
+        return;
+
+    quint64 in = t->bytesIn.load(), out = t->bytesOut.load();
+    QString inRate, outRate;
+    if(sinceRefresh.isValid() && sinceRefresh.elapsed() > 0) {
+        double secs = sinceRefresh.elapsed() / 1000.0;
+        inRate = ", " + formatBytes((in - lastIn) / secs) + "/s";
+        outRate = ", " + formatBytes((out - lastOut) / secs) + "/s";
+    }
+    sinceRefresh.start();
+    lastIn = in;
+    lastOut = out;
+
+    tunnelIn->setText(formatBytes(in) + inRate);
+    tunnelOut->setText(formatBytes(out) + outRate);
+    int micros = t->rttMicros.load();
+    rtt->setText(micros ? QString::number(micros / 1000.0, 'f', 1) + " ms" : "not measured yet");
+    stalls->setText(QString::number(t->windowStalls.load()) + " / " + QString::number(t->eagainSpins.load()));
+    forwards->setText(QString::number(t->forwards.load()) + ", " + QString::number(t->reconnects.load()) + " reconnects");
+}
+
+void StatsPanel::copySnapshot() {
+    if(db)
+        QApplication::clipboard()->setText(QJsonDocument(db->statsSnapshot()).toJson());
+}
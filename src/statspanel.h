@@ -0,0 +1,61 @@
+/*
+ * Copyright 2014 Oliver Giles
+ *
+ * This file is part of SequelJoe. SequelJoe is licensed under the
+ * GNU GPL version 3. See LICENSE or <http://www.gnu.org/licenses/>
+ * for more information
+ */
+#ifndef _SEQUELJOE_STATSPANEL_H_
+#define _SEQUELJOE_STATSPANEL_H_
+
+#include <QWidget>
+#include <QElapsedTimer>
+
+class DbConnection;
+class QLabel;
+class QFormLayout;
+class QTimer;
+
+// Live traffic counters for one connection and its SSH tunnel, to tell
+// whether time goes to the server, the SSH hop or the client. Refreshes
+// once a second while visible
+class StatsPanel : public QWidget
+{
+    Q_OBJECT
+public:
+    explicit StatsPanel(QWidget *parent = 0);
+
+    // db must outlive the panel, or be reset to null before it is deleted
+    void setConnection(const DbConnection* db);
+
+protected:
+    virtual void showEvent(QShowEvent *) override;
+    virtual void hideEvent(QHideEvent *) override;
+
+private slots:
+    void refresh();
+    void copySnapshot();
+
+private:
+    QLabel* addRow(QString label);
+
+    const DbConnection* db;
+    QTimer* timer;
+    QFormLayout* form;
+
+    QLabel* queries;
+    QLabel* queryTime;
+    QLabel* fetched;
+    QLabel* tunnelIn;
+    QLabel* tunnelOut;
+    QLabel* rtt;
+    QLabel* stalls;
+    QLabel* forwards;
+
+    // for the transfer rates
+    QElapsedTimer sinceRefresh;
+    quint64 lastIn = 0;
+    quint64 lastOut = 0;
+};
+
+#endif // _SEQUELJOE_STATSPANEL_H_
@@ -9,6 +9,8 @@
 #include "sqlmodel.h"
 #include "tableview.h"
 #include "textcelleditor.h"
+#include "binarycelleditor.h"
+#include "tablemodel.h"
 #include "constrainteditor.h"
 
 #include <QPainter>
@@ -20,8 +22,7 @@
 #include <QAbstractScrollArea>
 
 TableCell::TableCell(QObject *parent) :
-    QStyledItemDelegate(parent),
-    firstColumnIsHeader(false)
+    QStyledItemDelegate(parent)
 {
 }
 
@@ -29,19 +30,34 @@ QWidget* TableCell::createEditor(QWidget *parent, const QStyleOptionViewItem &op
     switch(index.data(EditorTypeRole).toInt()) {
     case SJCellEditLongText:
         return new TextCellEditor(parent);
+    case SJCellEditBinary:
+        return new BinaryCellEditor(parent);
     default:
         return QStyledItemDelegate::createEditor(parent, option, index);
     }
 }
 
 void TableCell::setEditorData(QWidget *editor, const QModelIndex &index) const {
-    if(TextCellEditor* tce = qobject_cast<TextCellEditor*>(editor))
+    // while only a prefix of the value is loaded the editor is read-only.
+    // TableView fetches the rest and this is called again when it arrives
+    if(TextCellEditor* tce = qobject_cast<TextCellEditor*>(editor)) {
         tce->setContent(index.data(Qt::EditRole).toString());
-    else
+        tce->setLoading(index.data(ValueTruncatedRole).toBool());
+    } else if(BinaryCellEditor* bce = qobject_cast<BinaryCellEditor*>(editor)) {
+        // fetches what it needs itself
+        bce->setSource(qobject_cast<TableModel*>(const_cast<QAbstractItemModel*>(index.model())), index);
+    } else {
         QStyledItemDelegate::setEditorData(editor, index);
+        if(QLineEdit* le = qobject_cast<QLineEdit*>(editor))
+            le->setReadOnly(index.data(ValueTruncatedRole).toBool());
+    }
 }
 
 void TableCell::setModelData(QWidget *editor, QAbstractItemModel *model, const QModelIndex &index) const {
+    // never write a prefix back over the full value. The editor was
+    // read-only, so there is no edit to lose
+    if(index.data(ValueTruncatedRole).toBool() || qobject_cast<BinaryCellEditor*>(editor))
+        return;
     if(TextCellEditor* tce = qobject_cast<TextCellEditor*>(editor))
         model->setData(index, tce->content());
     else
@@ -51,7 +67,7 @@ void TableCell::setModelData(QWidget *editor, QAbstractItemModel *model, const Q
 
 void TableCell::updateEditorGeometry(QWidget *editor, const QStyleOptionViewItem &option, const QModelIndex &index) const {
     QRect g = qobject_cast<QWidget*>(parent())->window()->geometry();
-    if(qobject_cast<TextCellEditor*>(editor))
+    if(qobject_cast<TextCellEditor*>(editor) || qobject_cast<BinaryCellEditor*>(editor))
         editor->setGeometry(g.x()+g.width()/8, g.y()+g.height()/8,g.width()*3/4,g.height()*3/4);
     else if(qobject_cast<ConstraintEditor*>(editor))
         editor->setGeometry(g.x()+(g.width()-editor->width())/2, g.y()+(g.height()-editor->height())/2,editor->width(),editor->height());
@@ -60,33 +76,66 @@ void TableCell::updateEditorGeometry(QWidget *editor, const QStyleOptionViewItem
 
 }
 
+// the cached render record for index, or null if the model doesn't keep one
+// (e.g. the pivot proxy), in which case we go through the roles as usual
+static const SqlModel::CellRender* renderRecord(const QModelIndex& index) {
+    const SqlModel* model = qobject_cast<const SqlModel*>(index.model());
+    return model ? model->renderRecord(index) : nullptr;
+}
+
+void TableCell::initStyleOption(QStyleOptionViewItem *option, const QModelIndex &index) const {
+    const SqlModel::CellRender* r = renderRecord(index);
+    if(!r)
+        return QStyledItemDelegate::initStyleOption(option, index);
+
+    // equivalent to the base implementation for the roles SqlModel provides
+    option->index = index;
+    if(r->alignment)
+        option->displayAlignment = r->alignment;
+    if(r->checkState != -1) {
+        option->features |= QStyleOptionViewItem::HasCheckIndicator;
+        option->checkState = Qt::CheckState(r->checkState);
+    }
+    if(r->display.isValid() && !r->display.isNull()) {
+        option->features |= QStyleOptionViewItem::HasDisplay;
+        option->text = displayText(r->display, option->locale);
+    }
+    option->backgroundBrush = QBrush();
+}
+
 void TableCell::paint(QPainter *painter, const QStyleOptionViewItem &option, const QModelIndex &index) const {
+    nPainted++;
     QStyleOptionViewItem opt(option);
     initStyleOption(&opt, index);
 
     if(index.parent().isValid()) {
         opt.rect.setLeft(0);
         opt.features &= ~QStyleOptionViewItem::HasDecoration;
-    } else if(firstColumnIsHeader && index.column() == 0) {
-        QStyleOptionHeader hopt;
-        hopt.rect = opt.rect;
-        hopt.state = QStyle::State_None;
-        hopt.orientation = Qt::Vertical;
-        hopt.textAlignment = Qt::AlignVCenter;
-        hopt.text = index.data().toString();
-        if (option.widget->isEnabled())
-            hopt.state |= QStyle::State_Enabled;
-        hopt.state |= QStyle::State_Active;
-        QApplication::style()->drawControl(QStyle::CE_Header, &hopt, painter);
     } else {
-        if(!firstColumnIsHeader && !index.data(ForeignKeyRole).value<ForeignKey>().isNull()) {
+        const SqlModel::CellRender* r = renderRecord(index);
+        bool foreignKey, expanded, isNull;
+        QVector<qreal> shades;
+        if(r) {
+            foreignKey = r->foreignKey;
+            expanded = r->expanded;
+            isNull = r->isNull;
+            shades = r->shades;
+        } else {
+            foreignKey = !index.data(ForeignKeyRole).value<ForeignKey>().isNull();
+            expanded = foreignKey && index.sibling(index.row(), 0).data(ExpandedColumnIndexRole).toInt() == index.column();
+            isNull = index.data().isNull() && index.data(Qt::CheckStateRole).isNull();
+            for(QVariant colour : index.data(Qt::TextColorRole).toList())
+                shades << colour.toDouble();
+        }
+
+        if(foreignKey) {
             int indicatorWidth = opt.rect.height() * 2 / 3;
             opt.decorationSize = QSize(indicatorWidth,indicatorWidth);
             opt.features |= QStyleOptionViewItem::HasDecoration;
             QStyledItemDelegate::paint(painter, opt, index);
             opt.rect.setWidth(indicatorWidth);
             QStyle* s = QApplication::style();
-            if(index.sibling(index.row(), 0).data(ExpandedColumnIndexRole).toInt() == index.column()) {
+            if(expanded) {
                 opt.state = QStyle::State_Children | QStyle::State_Open;
                 s->drawPrimitive(QStyle::PE_IndicatorBranch, &opt, painter);
             } else {
@@ -94,22 +143,21 @@ void TableCell::paint(QPainter *painter, const QStyleOptionViewItem &option, con
                 s->drawPrimitive(QStyle::PE_IndicatorBranch, &opt, painter);
             }
         } else {
-            QVariant shades = index.data(Qt::TextColorRole);
-            if(shades.isValid()) {
+            if(!shades.isEmpty()) {
                 QStyledItemDelegate::paint(painter, opt, index);
 
-                for(QVariant colour : shades.toList()) {
-                    QColor c = QColor::fromHsv(255 * colour.toDouble(),180,180);
-                    //c.setHsvF(c.hueF() * colour.toDouble(), c.saturationF(), c.valueF());
+                for(qreal colour : shades) {
+                    QColor c = QColor::fromHsv(255 * colour,180,180);
                     painter->setPen(c);
                     painter->drawText(opt.rect, "\u2666");
                     opt.rect.moveLeft(opt.rect.left()+10);
                 }
 
             } else {
-                if(index.data().isNull() && index.data(Qt::CheckStateRole).isNull()) {
+                if(isNull) {
                     opt.palette.setColor(QPalette::Text, Qt::lightGray);
                     opt.text = "null";
+                    opt.features |= QStyleOptionViewItem::HasDisplay;
                 }
                 QStyledItemDelegate::paint(painter, opt, index);
             }
@@ -118,16 +166,13 @@ void TableCell::paint(QPainter *painter, const QStyleOptionViewItem &option, con
     }
 }
 
-QSize TableCell::sizeHint(const QStyleOptionViewItem& option, const QModelIndex& index) const {
-    QSize sz = QStyledItemDelegate::sizeHint(option, index);
-    return firstColumnIsHeader ? QSize(sz.width(), sz.height() * index.data(HeightMultiple).toInt()) : sz;
-}
-
 bool TableCell::editorEvent(QEvent *event, QAbstractItemModel *model, const QStyleOptionViewItem &option, const QModelIndex &index) {
-    if(event->type() == QEvent::MouseButtonPress && !index.data(ForeignKeyRole).value<ForeignKey>().isNull()) {
+    const SqlModel::CellRender* r = renderRecord(index);
+    bool foreignKey = r ? r->foreignKey : !index.data(ForeignKeyRole).value<ForeignKey>().isNull();
+    if(event->type() == QEvent::MouseButtonPress && foreignKey) {
         QMouseEvent* me = static_cast<QMouseEvent*>(event);
-        QRect r = option.rect.adjusted(0,0,-option.rect.width() + option.rect.height() * 2 /3,0);
-        if(r.contains(me->pos())) {
+        QRect indicator = option.rect.adjusted(0,0,-option.rect.width() + option.rect.height() * 2 /3,0);
+        if(indicator.contains(me->pos())) {
             emit requestForeignKey(index);
             return true;
         }
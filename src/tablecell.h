@@ -20,19 +20,19 @@ public:
     void setModelData(QWidget *editor, QAbstractItemModel *model, const QModelIndex &index) const;
     void updateEditorGeometry(QWidget *editor, const QStyleOptionViewItem &option, const QModelIndex &index) const override;
     virtual void paint(QPainter *painter, const QStyleOptionViewItem &option, const QModelIndex &index) const;
-
-    void setFirstColumnIsHeader(bool v) { firstColumnIsHeader = v; }
-
-    QSize sizeHint(const QStyleOptionViewItem& option, const QModelIndex& index) const override;
+    // cells painted so far, see TableView::paintEvent
+    int paintCount() const { return nPainted; }
 
 signals:
     void requestForeignKey(const QModelIndex& index);
 
 protected:
+    void initStyleOption(QStyleOptionViewItem *option, const QModelIndex &index) const override;
     bool editorEvent(QEvent *event, QAbstractItemModel *model,
                      const QStyleOptionViewItem &option, const QModelIndex &index);
+
 private:
-    bool firstColumnIsHeader;
+    mutable int nPainted = 0;
 };
 
 #endif // _SEQUELJOE_TABLECELL_H_
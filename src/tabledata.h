@@ -63,6 +63,7 @@ struct Schema {
 
 struct TableMetadata {
     void resize(int nColumns) {
+        columnNames.resize(nColumns);
         columnTypes.resize(nColumns);
         columnComments.resize(nColumns);
         foreignKeys.resize(nColumns);
@@ -71,6 +72,7 @@ struct TableMetadata {
     int count() const { return size_; }
     int primaryKeyColumn = -1;
     int numRows = -1;
+    QVector<QString> columnNames;
     QVector<QString> columnTypes;
     QVector<QString> columnComments;
     QVector<ForeignKey> foreignKeys;
@@ -78,6 +80,9 @@ private:
     int size_ = 0;
 };
 
+// rows copied out of a result set, e.g. one window of a server-side cursor
+typedef QVector<QVector<QVariant>> ResultRows;
+
 struct Filter {
     QString column;
     QString operation;
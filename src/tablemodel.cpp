@@ -7,6 +7,7 @@
  */
 #include "tablemodel.h"
 #include "driver.h"
+#include "trace.h"
 
 #include <QSqlDriver>
 #include <QSqlField>
@@ -15,7 +16,9 @@
 TableModel::TableModel(DbConnection &db, QString table, QObject *parent) :
     SqlModel(db, parent),
     tableName(table),
-    where(Filter{})
+    where(Filter{}),
+    nTruncated(0),
+    chunkRequests(0)
 {
     rowsLimit = 100;
     setQuery("SELECT * FROM \"" + table + "\"");
@@ -26,23 +29,207 @@ void TableModel::describe(const Filter& f) {
     dataSafe = false;
     beginResetModel();
     where = f;
-    QMetaObject::invokeMethod(&db, "queryTableMetadata", Qt::QueuedConnection, Q_ARG(QString, tableName), Q_ARG(QObject*, this));
+    DbConnection* conn = &db;
+    QString table = tableName;
+    // the page can't be fetched without it
+    db.jobs().submit(JobQueue::VISIBLE_PAGE, "describe", [conn, table]{
+        return conn->queryTableMetadata(table);
+    }).then(this, [this](TableMetadata metadata){ describeComplete(metadata); });
 }
 
 void TableModel::describeComplete(TableMetadata metadata) {
+    SJ_TRACE("TableModel::describeComplete", "model");
     this->metadata = metadata;
+    // only fetch a prefix of long values when the primary key lets us get
+    // the rest later
+    lengthColumns.fill(-1, metadata.count());
+    binaryColumns.fill(false, metadata.count());
+    nTruncated = 0;
+    for(int i = 0; i < metadata.count(); ++i) {
+        QString type = metadata.columnTypes.at(i).toLower();
+        binaryColumns[i] = type.contains("blob") || type.contains("bytea") || type.contains("binary");
+    }
+    if(metadata.primaryKeyColumn != -1) {
+        for(int i = 0; i < metadata.count(); ++i) {
+            QString type = metadata.columnTypes.at(i).toLower();
+            bool isLong = type.contains("text") || type.contains("blob") || type.contains("bytea") || type.contains("clob");
+            if(isLong && i != metadata.primaryKeyColumn && !metadata.columnNames.at(i).isEmpty())
+                lengthColumns[i] = metadata.count() + nTruncated++;
+        }
+    }
     totalRecords = metadata.numRows;
     select();
 }
 
+void TableModel::prefill(const ForeignRow& row) {
+    beginResetModel();
+    preview = row;
+    endResetModel();
+}
+
+void TableModel::selectComplete(int nRows) {
+    fullValues.clear();
+    SqlModel::selectComplete(nRows);
+    if(dataSafe)
+        preview = ForeignRow{};
+    if(dataSafe && !selectPending)
+        resolveForeignKeys();
+}
+
+// Fetch the rows referenced from this page that aren't cached yet, with a
+// single query per referenced table rather than one per expanded cell
+void TableModel::resolveForeignKeys() {
+    const ForeignRowCache& cache = db.foreignRowCache();
+    // referenced table -> referenced column -> quoted values
+    QHash<QString, QHash<QString, QSet<QString>>> wanted;
+    for(int c = 0; c < metadata.foreignKeys.count() && c < columnCount(); ++c) {
+        const ForeignKey& fk = metadata.foreignKeys.at(c);
+        if(fk.isNull())
+            continue;
+        for(int r = 0; r < numRows; ++r) {
+            QVariant v = value(r, c);
+            if(!v.isNull() && !cache.contains(fk.refTable, fk.refColumn, v))
+                wanted[fk.refTable][fk.refColumn] << db.sqlDriver()->quote(v);
+        }
+    }
+    for(auto t = wanted.cbegin(); t != wanted.cend(); ++t) {
+        QStringList conditions;
+        for(auto c = t->cbegin(); c != t->cend(); ++c)
+            conditions << "\"" + c.key() + "\" IN (" + QStringList(c->toList()).join(",") + ")";
+        QString condition = conditions.join(" OR ");
+        DbConnection* conn = &db;
+        QString refTable = t.key();
+        QStringList refColumns = t->keys();
+        // only shown when hovering over a cell, so long values are cut short
+        // as they are on the page
+        db.jobs().submit(JobQueue::PREFETCH, "foreignRows", [conn, refTable, refColumns, condition]{
+            conn->queryForeignRows(refTable, refColumns, condition, PREVIEW_LENGTH);
+        }).then(this, [this]{ foreignRowsComplete(); });
+    }
+}
+
+void TableModel::foreignRowsComplete() {
+    if(dataSafe && numRows > 0)
+        emit dataChanged(index(0, 0), index(numRows - 1, columnCount() - 1), {Qt::ToolTipRole});
+}
+
+ForeignRow TableModel::foreignRow(const QModelIndex& index) const {
+    if(!dataSafe || !index.isValid() || index.column() >= metadata.foreignKeys.count() || index.row() >= numRows)
+        return ForeignRow{};
+    const ForeignKey& fk = metadata.foreignKeys.at(index.column());
+    if(fk.isNull())
+        return ForeignRow{};
+    return db.foreignRowCache().row(fk.refTable, fk.refColumn, value(index.row(), index.column()));
+}
+
 QString TableModel::prepareQuery() const {
+    QString q = query;
+    if(nTruncated > 0) {
+        QStringList columns, lengths;
+        for(int i = 0; i < metadata.count(); ++i) {
+            const QString& name = metadata.columnNames.at(i);
+            if(lengthColumns.at(i) == -1) {
+                columns << "\"" + name + "\"";
+            } else {
+                columns << db.sqlDriver()->prefixExpression(name, PREVIEW_LENGTH) + " AS \"" + name + "\"";
+                lengths << db.sqlDriver()->lengthExpression(name);
+            }
+        }
+        q = "SELECT " + (columns + lengths).join(", ") + " FROM \"" + tableName + "\"";
+    }
     if(!where.value.isEmpty()) {
-        return query + " WHERE \"" + where.column + "\" " + where.operation + " " + db.sqlDriver()->quote(where.value);
+        return q + " WHERE \"" + where.column + "\" " + where.operation + " " + db.sqlDriver()->quote(where.value);
     } else
-        return query;
+        return q;
+}
+
+int TableModel::columnCount(const QModelIndex &parent) const {
+    if(showingPreview())
+        return parent.isValid() ? 0 : preview.columns.count();
+    int n = SqlModel::columnCount(parent);
+    // hide the length columns
+    return parent.isValid() ? n : qMax(n - nTruncated, 0);
+}
+
+int TableModel::rowCount(const QModelIndex &parent) const {
+    if(showingPreview())
+        return parent.isValid() ? 0 : 1;
+    return SqlModel::rowCount(parent);
+}
+
+QModelIndex TableModel::index(int row, int column, const QModelIndex &parent) const {
+    if(showingPreview()) {
+        if(parent.isValid() || row != 0 || column < 0 || column >= preview.columns.count())
+            return QModelIndex{};
+        return createIndex(row, column, quintptr(-1));
+    }
+    return SqlModel::index(row, column, parent);
+}
+
+QVariant TableModel::headerData(int section, Qt::Orientation orientation, int role) const {
+    if(showingPreview())
+        return orientation == Qt::Horizontal && role == Qt::DisplayRole ? QVariant(preview.columns.value(section)) : QVariant();
+    return SqlModel::headerData(section, orientation, role);
+}
+
+Qt::ItemFlags TableModel::flags(const QModelIndex &index) const {
+    if(showingPreview())
+        return Qt::ItemIsEnabled | Qt::ItemIsSelectable;
+    return SqlModel::flags(index);
+}
+
+bool TableModel::valueTruncated(int row, int column) const {
+    if(column >= lengthColumns.count() || lengthColumns.at(column) == -1 || row >= numRows)
+        return false;
+    if(fullValues.contains(qMakePair(row, column)))
+        return false;
+    return value(row, lengthColumns.at(column)).toLongLong() > PREVIEW_LENGTH;
+}
+
+qint64 TableModel::valueLength(const QModelIndex& index) const {
+    if(!index.isValid() || index.column() >= lengthColumns.count() || lengthColumns.at(index.column()) == -1 || index.row() >= numRows)
+        return -1;
+    return value(index.row(), lengthColumns.at(index.column())).toLongLong();
+}
+
+int TableModel::fetchChunk(const QModelIndex& index, qint64 offset, int length) {
+    if(valueLength(index) == -1)
+        return -1;
+    QVariant key = value(index.row(), metadata.primaryKeyColumn);
+    QString query = "SELECT " + db.sqlDriver()->substringExpression(metadata.columnNames.at(index.column()), offset, length) +
+            " FROM \"" + tableName + "\" WHERE \"" + metadata.columnNames.at(metadata.primaryKeyColumn) + "\" = " + db.sqlDriver()->quote(key);
+    DbConnection* conn = &db;
+    int row = index.row();
+    int request = chunkRequests++;
+    db.jobs().submit(JobQueue::INTERACTIVE, "valueChunk", [conn, query]{
+        return conn->queryValueChunk(query);
+    }).then(this, [=](QByteArray data){ chunkComplete(request, row, key, data); });
+    return request;
+}
+
+void TableModel::chunkComplete(int request, int row, QVariant key, QByteArray data) {
+    // always answered, so the requester can stop waiting, but as a failure
+    // if the row has gone since
+    if(!dataSafe || selectPending || row >= numRows || value(row, metadata.primaryKeyColumn) != key)
+        data = QByteArray();
+    emit chunkReady(request, data);
+}
+
+void TableModel::valueComplete(int row, int column, QVariant key, QVariant value) {
+    // the page may have changed since the value was requested
+    if(!dataSafe || selectPending || row >= numRows || this->value(row, metadata.primaryKeyColumn) != key)
+        return;
+    fullValues.insert(qMakePair(row, column), value);
+    QModelIndex idx = index(row, column);
+    emit dataChanged(idx, idx);
 }
 
 QVariant TableModel::data(const QModelIndex &index, int role) const {
+    if(showingPreview()) {
+        if(!index.isValid() || index.column() >= preview.values.count() || (role != Qt::DisplayRole && role != Qt::EditRole))
+            return QVariant();
+        return preview.values.at(index.column());
+    }
     if(!dataSafe)
         return QVariant();
 
@@ -53,8 +240,27 @@ QVariant TableModel::data(const QModelIndex &index, int role) const {
         return expandedColumns.value(index.row());
     }
 
-    if(role == EditorTypeRole) // used by TableCell to know to use the popup editor
+    if(role == EditorTypeRole) { // used by TableCell to know to use the popup editor
+        if(binaryColumns.value(index.column()) && lengthColumns.value(index.column(), -1) != -1)
+            return SJCellEditBinary;
         return metadata.columnTypes[index.column()].toLower().contains("text") ? SJCellEditLongText : SJCellEditDefault;
+    }
+
+    // show binary values as hex rather than as mangled text
+    if(role == Qt::DisplayRole && binaryColumns.value(index.column()) && index.row() < numRows
+            && !(index.row() == updatingRow && currentRowModifications.contains(index.column()))) {
+        QVariant v = value(index.row(), index.column());
+        if(v.isNull())
+            return v;
+        QByteArray bytes = v.toByteArray();
+        qint64 length = valueLength(index);
+        if(length == -1)
+            length = bytes.size();
+        QString hex = "0x" + QString::fromLatin1(bytes.left(16).toHex());
+        if(length > 16)
+            hex += QChar(0x2026);
+        return hex + " (" + QString::number(length) + " bytes)";
+    }
 
     if(role == FilterColumnRole)
         return where.column;
@@ -66,6 +272,26 @@ QVariant TableModel::data(const QModelIndex &index, int role) const {
     if(role == ForeignKeyRole)
         return QVariant::fromValue<ForeignKey>(metadata.foreignKeys[index.column()]);
 
+    if(index.column() < lengthColumns.count() && lengthColumns.at(index.column()) != -1 && index.row() < numRows
+            && !(index.row() == updatingRow && currentRowModifications.contains(index.column()))) {
+        QPair<int,int> cell(index.row(), index.column());
+        if(role == ValueTruncatedRole)
+            return valueTruncated(index.row(), index.column());
+        if(role == Qt::EditRole && fullValues.contains(cell))
+            return fullValues.value(cell);
+        if(role == Qt::DisplayRole && value(index.row(), lengthColumns.at(index.column())).toLongLong() > PREVIEW_LENGTH)
+            return SqlModel::data(index, role).toString() + QChar(0x2026);
+    }
+
+    if(role == Qt::ToolTipRole) {
+        // preview of the referenced row
+        ForeignRow fr = foreignRow(index);
+        QStringList lines;
+        for(int i = 0; i < fr.columns.count(); ++i)
+            lines << fr.columns.at(i) + ": " + fr.values.at(i).toString();
+        return fr.isNull() ? QVariant() : lines.join("\n");
+    }
+
     return SqlModel::data(index, role);
 }
 
@@ -79,6 +305,19 @@ bool TableModel::setData(const QModelIndex &index, const QVariant &value, int ro
     } else if(role == FilterValueRole) {
         where.value = value.toString();
         return true;
+    } else if(role == FetchFullValueRole) {
+        if(!valueTruncated(index.row(), index.column()))
+            return false;
+        QVariant key = this->value(index.row(), metadata.primaryKeyColumn);
+        QString query = "SELECT \"" + metadata.columnNames.at(index.column()) + "\" FROM \"" + tableName + "\" WHERE \"" +
+                metadata.columnNames.at(metadata.primaryKeyColumn) + "\" = " + db.sqlDriver()->quote(key);
+        DbConnection* conn = &db;
+        int row = index.row();
+        int column = index.column();
+        db.jobs().submit(JobQueue::INTERACTIVE, "value", [conn, query]{
+            return conn->queryValue(query);
+        }).then(this, [=](QVariant full){ valueComplete(row, column, key, full); });
+        return true;
     } else
         return SqlModel::setData(index, value, role);
 }
@@ -96,7 +335,7 @@ bool TableModel::submit() {
                 values << db.sqlDriver()->quote(it.value());
             }
             QString query = "INSERT INTO \"" + tableName + "\" (\"" + columns.join("\",\"") + "\") VALUES(" + values.join(",") + ")";
-            QMetaObject::invokeMethod(&db, "queryTableUpdate", Q_ARG(QString, query), Q_ARG(QObject*, this));
+            queueUpdate(query);
         } else {
             QStringList updates;
             for(auto it = currentRowModifications.cbegin(); it != currentRowModifications.cend(); ++it) {
@@ -120,7 +359,7 @@ bool TableModel::submit() {
                     sep = " AND ";
                 }
             }
-            QMetaObject::invokeMethod(&db, "queryTableUpdate", Q_ARG(QString, query), Q_ARG(QObject*, this));
+            queueUpdate(query);
         }
         return true;
     }
@@ -143,7 +382,7 @@ bool TableModel::deleteRows(QSet<int> rows) {
         }
         QString query("DELETE FROM \"" + tableName + "\" WHERE \"" + res.record().fieldName(metadata.primaryKeyColumn) + "\" IN ("+rowIds.join(",")+")");
 
-        QMetaObject::invokeMethod(&db, "queryTableUpdate", Q_ARG(QString, query), Q_ARG(QObject*, this), Q_ARG(const char*,"deleteComplete"));
+        queueUpdate(query, &TableModel::deleteComplete);
     } else {
         for(int i : rows) {
             // otherwise we have to compare every column
@@ -160,7 +399,7 @@ bool TableModel::deleteRows(QSet<int> rows) {
             }
             // todo what here
             //content.remove(i);
-            QMetaObject::invokeMethod(&db, "queryTableUpdate", Q_ARG(QString, query), Q_ARG(QObject*, this), Q_ARG(const char*,"deleteComplete"));
+            queueUpdate(query, &TableModel::deleteComplete);
         }
     }
     return true;
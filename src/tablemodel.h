@@ -18,24 +18,62 @@ public:
     virtual ~TableModel() {}
 
     virtual void describe(const Filter &where = Filter{});
+    // shows row, e.g. from the foreign row cache, read-only until the
+    // table has loaded
+    void prefill(const ForeignRow& row);
+    int columnCount(const QModelIndex &parent = QModelIndex()) const override;
+    int rowCount(const QModelIndex &parent = QModelIndex()) const override;
+    QModelIndex index(int row, int column, const QModelIndex &parent = QModelIndex{}) const override;
     QVariant data(const QModelIndex &index, int role = Qt::DisplayRole) const override;
+    QVariant headerData(int section, Qt::Orientation orientation, int role) const override;
     bool setData(const QModelIndex &index, const QVariant &value, int role) override;
+    Qt::ItemFlags flags(const QModelIndex &index) const override;
     void setFilter(Filter& f) { where = f; select();}
+    // the referenced row for a foreign key cell, if it has been fetched
+    ForeignRow foreignRow(const QModelIndex& index) const;
+
+    // full length of a value fetched as a prefix, -1 if it was fetched whole
+    qint64 valueLength(const QModelIndex& index) const;
+    // fetch part of a value fetched as a prefix. Returns an id for the request
+    // which chunkReady reports with the data, a null array if it failed, or
+    // -1 if the value can't be fetched in parts
+    int fetchChunk(const QModelIndex& index, qint64 offset, int length);
+
+signals:
+    void chunkReady(int request, QByteArray data);
 
 protected slots:
     bool submit() override;
     void revert() override;
 
 protected:
+    void selectComplete(int nRows) override;
     virtual QString prepareQuery() const override;
     virtual bool deleteRows(QSet<int>) override;
 
-private slots:
+private:
     void describeComplete(TableMetadata metadata);
+    void foreignRowsComplete();
+    void valueComplete(int row, int column, QVariant key, QVariant value);
+    void chunkComplete(int request, int row, QVariant key, QByteArray data);
+    void resolveForeignKeys();
+    bool valueTruncated(int row, int column) const;
+    bool showingPreview() const { return !dataSafe && !preview.isNull(); }
+
+    // characters of long text/blob columns fetched for display
+    enum { PREVIEW_LENGTH = 256 };
 
-private:
     QString tableName;
     Filter where;
+    // for each column fetched as a prefix, the result column holding its full
+    // length (appended after the table's own columns), otherwise -1
+    QVector<int> lengthColumns;
+    QVector<bool> binaryColumns;
+    int nTruncated;
+    int chunkRequests;
+    QHash<QPair<int,int>, QVariant> fullValues;
+    // see prefill
+    ForeignRow preview;
 };
 
 #endif // _SEQUELJOE_TABLEMODEL_H
@@ -10,6 +10,9 @@
 #include "tablecell.h"
 #include "tablemodel.h"
 #include "loadingoverlay.h"
+#include "fontmetrics.h"
+#include "roles.h"
+#include "trace.h"
 
 #include <QHeaderView>
 #include <QMenu>
@@ -18,6 +21,8 @@
 #include <QResizeEvent>
 #include <QLineEdit>
 #include <QLabel>
+#include <QApplication>
+#include <QClipboard>
 
 TableView::TableView(QWidget *parent) :
     QTreeView(parent)
@@ -41,6 +46,12 @@ TableView::TableView(QWidget *parent) :
     connect(deleteRowAction, SIGNAL(triggered()), this, SLOT(handleDeleteRow()));
     addRowAction = new QAction("Append row", contextMenu);
     connect(addRowAction, SIGNAL(triggered()), this, SLOT(handleAddRow()));
+    copyAction = new QAction("Copy", this);
+    copyAction->setShortcut(QKeySequence::Copy);
+    copyAction->setShortcutContext(Qt::WidgetShortcut);
+    connect(copyAction, SIGNAL(triggered()), this, SLOT(handleCopy()));
+    addAction(copyAction);
+    contextMenu->addAction(copyAction);
     contextMenu->addAction(setNullAction);
     contextMenu->addAction(deleteRowAction);
     contextMenu->addAction(addRowAction);
@@ -49,6 +60,16 @@ TableView::TableView(QWidget *parent) :
     loadingOverlay->hide();
 }
 
+bool TableView::edit(const QModelIndex &index, EditTrigger trigger, QEvent *event) {
+    if(!QTreeView::edit(index, trigger, event))
+        return false;
+    // only a prefix of the value is loaded, fetch the rest for the editor.
+    // The binary editor fetches what it needs itself
+    if(index.data(ValueTruncatedRole).toBool() && index.data(EditorTypeRole).toInt() != SJCellEditBinary)
+        model()->setData(index, QVariant(), FetchFullValueRole);
+    return true;
+}
+
 void TableView::closeEditor(QWidget *editor, QAbstractItemDelegate::EndEditHint hint) {
     QModelIndex idx = currentIndex();
     QModelIndex nextIndex = idx;
@@ -89,13 +110,49 @@ void TableView::closeEditor(QWidget *editor, QAbstractItemDelegate::EndEditHint
 }
 
 void TableView::adjustColumnSizes() {
+    SJ_TRACE("TableView::adjustColumnSizes", "view");
+    // same padding QStyledItemDelegate puts around text
+    int margin = (style()->pixelMetric(QStyle::PM_FocusFrameHMargin, 0, this) + 1) * 2;
     for(int i = 0; i < model()->columnCount(); ++i) {
-        int sh = sizeHintForColumn(i);
+        int sh;
+        // prefer the width estimated by the model while fetching, measuring
+        // each cell through the delegate is expensive for large pages
+        QVariant chars = model()->headerData(i, Qt::Horizontal, ColumnCharWidthRole);
+        if(chars.isValid())
+            sh = textWidth(chars.toInt()) + margin;
+        else
+            sh = sizeHintForColumn(i);
         int cw = sh < 0 ? header()->sectionSizeHint(i) : qMax(sh, header()->sectionSizeHint(i));
         header()->resizeSection(i, qMin(cw, 250));
     }
 }
 
+int TableView::textWidth(int chars) const {
+    int bucket = (chars + WIDTH_BUCKET - 1) / WIDTH_BUCKET;
+    auto it = textWidths.constFind(bucket);
+    if(it != textWidths.constEnd())
+        return it.value();
+    int w = horizontalAdvance(fontMetrics(), QString(bucket * WIDTH_BUCKET, '0'));
+    textWidths.insert(bucket, w);
+    return w;
+}
+
+void TableView::paintEvent(QPaintEvent *event) {
+    // one span per batch of cells, rather than one per cell
+    TraceSpan span("TableCell::paint", "view");
+    TableCell* cell = qobject_cast<TableCell*>(itemDelegate());
+    int before = cell ? cell->paintCount() : 0;
+    QTreeView::paintEvent(event);
+    if(cell)
+        span.setArg("cells", cell->paintCount() - before);
+}
+
+void TableView::changeEvent(QEvent *event) {
+    if(event->type() == QEvent::FontChange || event->type() == QEvent::StyleChange)
+        textWidths.clear();
+    QTreeView::changeEvent(event);
+}
+
 void TableView::setModel(QAbstractItemModel *m) {
     if(model() == m)
         return;
@@ -113,6 +170,14 @@ void TableView::setModel(QAbstractItemModel *m) {
         connect(m, &QAbstractItemModel::rowsRemoved, [=](){showLoadingOverlay(false);});
         connect(m, &QAbstractItemModel::modelAboutToBeReset, [=](){showLoadingOverlay(true);});
         connect(m, SIGNAL(modelReset()), this, SLOT(handleModelReset()), Qt::QueuedConnection);
+        connect(m, &QAbstractItemModel::dataChanged, [=](const QModelIndex& tl, const QModelIndex& br){
+            if(pendingCopy.isValid() && pendingCopy.row() >= tl.row() && pendingCopy.row() <= br.row()
+                    && pendingCopy.column() >= tl.column() && pendingCopy.column() <= br.column()
+                    && !pendingCopy.data(ValueTruncatedRole).toBool()) {
+                QApplication::clipboard()->setText(pendingCopy.data(Qt::EditRole).toString());
+                pendingCopy = QPersistentModelIndex();
+            }
+        });
     }
 
     if(m) // this maybe works better after the data has been loaded?
@@ -137,19 +202,24 @@ QWidget* TableView::createChildTable(const QModelIndex& index) {
     label->setText("SELECT * FROM \"" + fk.refTable + "\" WHERE \"" + fk.refColumn + "\" = '" + index.data().toString() + "'");
     frame->layout()->addWidget(label);
 
+    TableModel* m = qobject_cast<TableModel*>(model());
+    if(!m)
+        return frame;
+
     TableView* view = new TableView(frame);
     view->setMaximumHeight(QWIDGETSIZE_MAX);
     view->setSizeAdjustPolicy(QAbstractScrollArea::AdjustToContents);
     view->setVerticalScrollBarPolicy(Qt::ScrollBarAlwaysOff);
-
-    TableModel* m = static_cast<TableModel*>(model());
-    if(m) {
-        TableModel* childModel = new TableModel(*m, fk.refTable);
-        view->setModel(childModel);
-        childModel->describe(Filter{fk.refColumn, "=", index.data().toString()});
-    }
+    TableModel* childModel = new TableModel(*m, fk.refTable);
+    // already fetched along with the page, shown while the row loads
+    ForeignRow cached = m->foreignRow(index);
+    if(!cached.isNull())
+        childModel->prefill(cached);
+    view->setModel(childModel);
     frame->layout()->addWidget(view);
 
+    childModel->describe(Filter{fk.refColumn, "=", index.data().toString()});
+
     return frame;
 }
 
@@ -159,7 +229,7 @@ void TableView::resizeEvent(QResizeEvent *event) {
 }
 
 void TableView::showLoadingOverlay(bool show) {
-    loadingOverlay->setVisible(show);
+    loadingOverlay->setLoading(show);
 }
 
 void TableView::openMenu(QPoint p) {
@@ -189,6 +259,19 @@ void TableView::handleAddRow() {
     edit(newRowIndex);
 }
 
+void TableView::handleCopy() {
+    QModelIndex index = currentIndex();
+    if(!index.isValid())
+        return;
+    // copy the whole value, not just the part fetched for display
+    if(index.data(ValueTruncatedRole).toBool()) {
+        pendingCopy = index;
+        model()->setData(index, QVariant(), FetchFullValueRole);
+    } else {
+        QApplication::clipboard()->setText(index.data(Qt::EditRole).toString());
+    }
+}
+
 void TableView::toggleForeignTable(const QModelIndex& index) {
     QModelIndex first = index.sibling(index.row(), 0);
     if(isExpanded(first)) {
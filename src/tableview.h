@@ -9,21 +9,25 @@
 #define _SEQUELJOE_TABLEVIEW_H_
 
 #include <QTreeView>
+#include <QPersistentModelIndex>
 
 class QMenu;
 class QAction;
+class LoadingOverlay;
 
 class TableView : public QTreeView
 {
     Q_OBJECT
 public:
     explicit TableView(QWidget *parent = 0);
+    using QTreeView::edit;
 
 public slots:
     void openMenu(QPoint);
     void handleSetNull();
     void handleDeleteRow();
     void handleAddRow();
+    void handleCopy();
     void showLoadingOverlay(bool show);
 
     void setModel(QAbstractItemModel *model);
@@ -33,7 +37,10 @@ protected slots:
     void closeEditor(QWidget *editor, QAbstractItemDelegate::EndEditHint hint) override;
 
 protected:
+    bool edit(const QModelIndex &index, EditTrigger trigger, QEvent *event) override;
     void resizeEvent(QResizeEvent *event) override;
+    void changeEvent(QEvent *event) override;
+    void paintEvent(QPaintEvent *event) override;
     QMenu* contextMenu;
 
 private slots:
@@ -42,12 +49,19 @@ private slots:
 
 private:
     virtual QWidget* createChildTable(const QModelIndex& index);
+    int textWidth(int chars) const;
 
     QAction* setNullAction;
     QAction* deleteRowAction;
     QAction* addRowAction;
-    QWidget* loadingOverlay;
+    QAction* copyAction;
+    // cell to copy once its full value has been fetched
+    QPersistentModelIndex pendingCopy;
+    LoadingOverlay* loadingOverlay;
     QHash<int,QHash<int,QWidget*>> foreignTableViews;
+    // pixel width of a run of characters, by bucket of WIDTH_BUCKET characters
+    enum { WIDTH_BUCKET = 4 };
+    mutable QHash<int,int> textWidths;
 };
 
 #endif // _SEQUELJOE_TABLEVIEW_H_
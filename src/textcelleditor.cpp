@@ -28,3 +28,12 @@ void TextCellEditor::setContent(const QString& txt) {
 QString TextCellEditor::content() const {
     return editor->document()->toPlainText();
 }
+
+void TextCellEditor::setLoading(bool loading) {
+    editor->setReadOnly(loading);
+    setWindowTitle(loading ? "Edit Text (loading...)" : "Edit Text");
+}
+
+bool TextCellEditor::isLoading() const {
+    return editor->isReadOnly();
+}
@@ -21,6 +21,9 @@ public:
 
     void setContent(const QString& txt);
     QString content() const;
+    // read-only while the full value is being fetched
+    void setLoading(bool loading);
+    bool isLoading() const;
 
 private:
     QPlainTextEdit* editor;
@@ -0,0 +1,166 @@
+/*
+ * Copyright 2014 Oliver Giles
+ *
+ * This file is part of SequelJoe. SequelJoe is licensed under the
+ * GNU GPL version 3. See LICENSE or <http://www.gnu.org/licenses/>
+ * for more information
+ */
+#include "trace.h"
+
+#include <QCoreApplication>
+#include <QElapsedTimer>
+#include <QFile>
+#include <QHash>
+#include <QJsonArray>
+#include <QJsonDocument>
+#include <QMutex>
+#include <QStringList>
+#include <QThread>
+#include <QVector>
+
+namespace {
+
+struct Event {
+    const char* name;
+    const char* category;
+    char phase;
+    int tid;
+    qint64 ts;
+    qint64 duration;
+    quintptr id;
+    QJsonObject args;
+};
+
+// a trace holds at most this many events, so that one left running doesn't
+// eat all the memory. Later events are counted but dropped
+enum { MAX_EVENTS = 2000000 };
+
+QMutex lock;
+QString path;
+QElapsedTimer clock;
+QVector<Event> events;
+int dropped;
+// small numbers for the threads seen so far, and their names
+QHash<Qt::HANDLE, int> threads;
+QStringList threadNames;
+
+// call with lock held
+int threadId() {
+    Qt::HANDLE h = QThread::currentThreadId();
+    auto it = threads.constFind(h);
+    if(it != threads.constEnd())
+        return it.value();
+    QThread* t = QThread::currentThread();
+    QString name = t->objectName();
+    if(name.isEmpty())
+        name = QCoreApplication::instance() && t == QCoreApplication::instance()->thread() ?
+                    "GUI" : "Thread " + QString::number(threads.count());
+    threadNames << name;
+    return *threads.insert(h, threads.count());
+}
+
+// call with lock held
+void append(Event e) {
+    if(events.count() >= MAX_EVENTS) {
+        dropped++;
+        return;
+    }
+    e.tid = threadId();
+    events.append(e);
+}
+
+}
+
+QAtomicInt Trace::recording;
+
+void Trace::start(QString file) {
+    QMutexLocker locker(&lock);
+    path = file;
+    events.clear();
+    dropped = 0;
+    threads.clear();
+    threadNames.clear();
+    clock.start();
+    recording = 1;
+}
+
+bool Trace::stop(QString* error) {
+    recording = 0;
+    QMutexLocker locker(&lock);
+    QJsonArray all;
+    for(int i = 0; i < threadNames.count(); ++i) {
+        QJsonObject args;
+        args["name"] = threadNames.at(i);
+        QJsonObject m;
+        m["ph"] = QString("M");
+        m["name"] = QString("thread_name");
+        m["pid"] = 1;
+        m["tid"] = i;
+        m["args"] = args;
+        all.append(m);
+    }
+    for(const Event& e : events) {
+        QJsonObject o;
+        o["name"] = QString(e.name);
+        o["cat"] = QString(e.category);
+        o["ph"] = QString(e.phase);
+        o["pid"] = 1;
+        o["tid"] = e.tid;
+        o["ts"] = double(e.ts);
+        if(e.phase == 'X') {
+            o["dur"] = double(e.duration);
+            if(!e.args.isEmpty())
+                o["args"] = e.args;
+        } else {
+            o["id"] = QString::number(e.id, 16);
+            // the flow ends in the span around it rather than the next one
+            if(e.phase == 'f')
+                o["bp"] = QString("e");
+        }
+        all.append(o);
+    }
+    QJsonObject doc;
+    doc["traceEvents"] = all;
+    doc["displayTimeUnit"] = QString("ms");
+    if(dropped > 0)
+        doc["droppedEvents"] = dropped;
+    events.clear();
+
+    QFile f(path);
+    if(!f.open(QIODevice::WriteOnly | QIODevice::Truncate) || f.write(QJsonDocument(doc).toJson(QJsonDocument::Compact)) < 0) {
+        if(error)
+            *error = f.errorString();
+        return false;
+    }
+    return true;
+}
+
+void Trace::startFromEnvironment() {
+    QString file = qgetenv(ENV_VAR);
+    if(!file.isEmpty())
+        start(file);
+}
+
+qint64 Trace::now() {
+    return clock.nsecsElapsed() / 1000;
+}
+
+void Trace::complete(const char* name, const char* category, qint64 start, qint64 duration, const QJsonObject& args) {
+    QMutexLocker locker(&lock);
+    if(isRecording())
+        append(Event{name, category, 'X', 0, start, duration, 0, args});
+}
+
+void Trace::flowBegin(const char* name, const void* id) {
+    if(!isRecording())
+        return;
+    QMutexLocker locker(&lock);
+    append(Event{name, "flow", 's', 0, now(), 0, quintptr(id), QJsonObject()});
+}
+
+void Trace::flowEnd(const char* name, const void* id) {
+    if(!isRecording())
+        return;
+    QMutexLocker locker(&lock);
+    append(Event{name, "flow", 'f', 0, now(), 0, quintptr(id), QJsonObject()});
+}
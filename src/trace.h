@@ -0,0 +1,76 @@
+/*
+ * Copyright 2014 Oliver Giles
+ *
+ * This file is part of SequelJoe. SequelJoe is licensed under the
+ * GNU GPL version 3. See LICENSE or <http://www.gnu.org/licenses/>
+ * for more information
+ */
+#ifndef _SEQUELJOE_TRACE_H_
+#define _SEQUELJOE_TRACE_H_
+
+#include <QAtomicInt>
+#include <QJsonObject>
+#include <QString>
+
+// Records spans of work from any thread and writes them out in the Chrome
+// trace event format, to be opened in chrome://tracing or ui.perfetto.dev.
+// Always compiled in: while not recording, a span costs one atomic load
+class Trace {
+public:
+    // discards anything recorded so far
+    static void start(QString path);
+    // writes what was recorded to the path given to start
+    static bool stop(QString* error = nullptr);
+    static bool isRecording() { return recording.load() != 0; }
+    // starts recording to the file named by ENV_VAR, if set
+    static void startFromEnvironment();
+
+    // microseconds since recording started
+    static qint64 now();
+    static void complete(const char* name, const char* category, qint64 start, qint64 duration, const QJsonObject& args);
+    // a hop between threads, e.g. a queued call: begins in the span that
+    // posts it and ends in the span that handles it. id tells hops of the
+    // same name apart, e.g. the model making the request
+    static void flowBegin(const char* name, const void* id);
+    static void flowEnd(const char* name, const void* id);
+
+    static constexpr const char* ENV_VAR = "SJ_TRACE";
+
+private:
+    static QAtomicInt recording;
+};
+
+// Records the time from its construction to end() or its destruction
+class TraceSpan {
+public:
+    TraceSpan(const char* name, const char* category) :
+        name(name), category(category), start(Trace::isRecording() ? Trace::now() : -1) {}
+    ~TraceSpan() { end(); }
+
+    bool isRecording() const { return start != -1; }
+    // shown with the span. Skip computing expensive values unless isRecording
+    template<typename T> void setArg(const char* key, T value) {
+        if(isRecording())
+            args[key] = value;
+    }
+    void end() {
+        if(isRecording() && Trace::isRecording())
+            Trace::complete(name, category, start, Trace::now() - start, args);
+        start = -1;
+    }
+    // drops the span, e.g. when it turns out nothing was done
+    void discard() { start = -1; }
+
+private:
+    const char* name;
+    const char* category;
+    qint64 start;
+    QJsonObject args;
+};
+
+#define SJ_TRACE_JOIN2(a, b) a##b
+#define SJ_TRACE_JOIN(a, b) SJ_TRACE_JOIN2(a, b)
+// a span named name from here to the end of the enclosing scope
+#define SJ_TRACE(name, category) TraceSpan SJ_TRACE_JOIN(traceSpan, __LINE__)(name, category)
+
+#endif // _SEQUELJOE_TRACE_H_
@@ -41,6 +41,11 @@ ViewToolBar::ViewToolBar(QWidget *parent) :
     forward = QToolBar::addAction(">", this, SIGNAL(historyForward()));
     forward->setEnabled(false);
 
+    QAction* stats = QToolBar::addAction("Stats");
+    stats->setCheckable(true);
+    connect(stats, SIGNAL(toggled(bool)), this, SIGNAL(statsToggled(bool)));
+    viewActions.append(stats);
+
     viewActions.append(addAction(QIcon(":disconnect"), "Disconnect", this, SIGNAL(disconnect())));
 }
 
@@ -38,6 +38,7 @@ signals:
     void dbChanged(QString);
     void historyBack();
     void historyForward();
+    void statsToggled(bool);
 
 private slots:
     void showContent() { emit panelChanged(PANEL_CONTENT); }